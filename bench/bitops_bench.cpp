@@ -0,0 +1,132 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Microbenchmark of the bitset kernels of bitops.hpp.
+//
+// For bitsets of increasing width, it measures the successor union of the
+// powerset construction: the rows of `k` states are OR-ed together and
+// restricted to the states of an SCC. The reference loop is the one used
+// before the kernels existed, `(dst |= row) &= mask` for each row; it is
+// compared with the union followed by one masking pass, for each
+// instruction set supported by the CPU. The equality test used for the
+// breakpoint check P = Q is measured as well.
+//
+// Usage: bitops_bench [ITERATIONS]
+
+#include <bitops.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+  using bits::word;
+
+  // Prevents the compiler from optimizing the measured loops away
+  volatile word sink;
+
+  template <class F>
+  double ns_per_op(unsigned iterations, F f)
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i)
+      f();
+    std::chrono::duration<double, std::nano> d =
+      std::chrono::steady_clock::now() - start;
+    return d.count() / iterations;
+  }
+
+  void reference_union(word* dst, const std::vector<word>& rows,
+                       unsigned k, const word* mask, size_t nw)
+  {
+    bits::fill_zero(dst, nw);
+    for (unsigned s = 0; s < k; ++s)
+      for (size_t i = 0; i < nw; ++i)
+        (dst[i] |= rows[s * nw + i]) &= mask[i];
+  }
+
+  bool kernel_union(word* dst, const std::vector<word>& rows,
+                    unsigned k, const word* mask, size_t nw)
+  {
+    bits::fill_zero(dst, nw);
+    for (unsigned s = 0; s < k; ++s)
+      bits::or_into(dst, rows.data() + s * nw, nw);
+    return bits::and_into(dst, mask, nw);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  unsigned iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const unsigned k = 8; // number of states in the set
+
+  std::mt19937_64 gen(42);
+  const bits::isa levels[] = { bits::isa::scalar, bits::isa::avx2,
+                               bits::isa::avx512 };
+
+  std::cout << std::setw(8) << "states" << std::setw(10) << "kernel"
+            << std::setw(12) << "union ns" << std::setw(10) << "speedup"
+            << std::setw(12) << "equal ns" << '\n';
+
+  for (size_t nw: {2, 8, 32, 128, 512})
+    {
+      std::vector<word> rows(k * nw);
+      std::vector<word> mask(nw);
+      for (auto& w: rows)
+        w = gen() & gen(); // sparse rows
+      for (auto& w: mask)
+        w = gen() | gen();
+      std::vector<word> ref(nw), res(nw), other(nw);
+
+      double base = ns_per_op(iterations, [&]() {
+        reference_union(ref.data(), rows, k, mask.data(), nw);
+        sink = ref[0];
+      });
+      std::cout << std::setw(8) << nw * 64 << std::setw(10) << "reference"
+                << std::setw(12) << std::fixed << std::setprecision(1) << base
+                << std::setw(10) << "1.00" << '\n';
+
+      for (auto level: levels)
+        {
+          if (!bits::select(level))
+            continue;
+          kernel_union(res.data(), rows, k, mask.data(), nw);
+          if (!bits::equal(ref.data(), res.data(), nw))
+            {
+              std::cerr << bits::name(level) << ": wrong result\n";
+              return 1;
+            }
+          double t = ns_per_op(iterations, [&]() {
+            sink = kernel_union(res.data(), rows, k, mask.data(), nw);
+          });
+          bits::copy(other.data(), res.data(), nw);
+          double e = ns_per_op(iterations, [&]() {
+            sink = bits::equal(res.data(), other.data(), nw);
+          });
+          std::cout << std::setw(8) << "" << std::setw(10) << bits::name(level)
+                    << std::setw(12) << t
+                    << std::setw(10) << std::setprecision(2) << base / t
+                    << std::setw(12) << std::setprecision(1) << e << '\n';
+        }
+    }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+## Copyright (C) 2019-2020  The Seminator Authors
+##
+## This file is a part of Seminator, a tool for semi-determinization
+## of omega automata.
+##
+## Seminator is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## Seminator is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Compares --predict-jobs with the exhaustive run of all the jobs.
+#
+# For each file of formulae, the formulae are translated by ltl2tgba and
+# the automata are semi-determinized by `seminator` (all jobs) and by
+# `seminator --predict-jobs=K` for K = 1 and 2. The table gives, for
+# each mode, the total number of states of the results, the number of
+# automata for which the result is larger than the exhaustive one, and
+# the total time in seconds.
+#
+# Usage: predict_bench.sh [SEMINATOR [FORMULAE...]]
+# (default: ./seminator and formulae/*.ltl)
+
+set -e
+
+seminator=${1-./seminator}
+test $# -gt 0 && shift
+test $# -gt 0 || set -- ${abs_top_srcdir-.}/formulae/*.ltl
+
+tmp=${TMPDIR-/tmp}/predict_bench.$$
+mkdir "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+now() {
+  date +%s.%N
+}
+
+# run NAME OPTIONS...: semi-determinizes $tmp/in.hoa into $tmp/NAME.size
+# (one size per line) and prints the elapsed time
+run() {
+  name=$1
+  shift
+  start=`now`
+  "$seminator" "$@" "$tmp/in.hoa" | autfilt --stats=%s > "$tmp/$name.size"
+  end=`now`
+  echo "$end - $start" | bc
+}
+
+# Total size of the results of NAME
+sum() {
+  awk '{s+=$1} END {print s}' "$tmp/$1.size"
+}
+
+# Number of results of NAME larger than those of all jobs
+larger() {
+  paste "$tmp/all.size" "$tmp/$1.size" | awk '$2>$1 {n++} END {print n+0}'
+}
+
+printf '%-22s %5s | %8s %8s | %8s %6s %8s | %8s %6s %8s\n' \
+  file auts all time k=1 larger time k=2 larger time
+for f in "$@"; do
+  ltl2tgba -F "$f" > "$tmp/in.hoa"
+  t0=`run all`
+  t1=`run k1 --predict-jobs=1`
+  t2=`run k2 --predict-jobs=2`
+  n=`wc -l < "$tmp/all.size"`
+  printf '%-22s %5d | %8d %8.2f | %8d %6d %8.2f | %8d %6d %8.2f\n' \
+    `basename "$f"` $n `sum all` $t0 `sum k1` `larger k1` $t1 \
+    `sum k2` `larger k2` $t2
+done
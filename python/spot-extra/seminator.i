@@ -26,6 +26,7 @@
 %shared_ptr(spot::bdd_dict)
 %shared_ptr(spot::twa)
 %shared_ptr(spot::twa_graph)
+%shared_ptr(spot::twa_word)
 
 
 %{
@@ -38,11 +39,18 @@
 %import(module="spot.impl") <spot/twa/twa.hh>
 %import(module="spot.impl") <spot/twa/twagraph.hh>
 %import(module="spot.impl") <spot/misc/optionmap.hh>
+%import(module="spot.impl") <spot/twaalgos/word.hh>
 
 %exception {
   try {
     $action
   }
+  catch (const budget_exceeded& e)
+  {
+    PyErr_SetString(e.resource() == budget_exceeded::time
+                    ? PyExc_TimeoutError : PyExc_MemoryError, e.what());
+    SWIG_fail;
+  }
   catch (const std::runtime_error& e)
   {
     SWIG_exception(SWIG_RuntimeError, e.what());
@@ -50,6 +58,7 @@
 }
 
 %rename(semi_determinize_cpp) semi_determinize;
+%rename(semi_determinize_lazy_cpp) semi_determinize_lazy;
 %include <seminator.hpp>
 
 
@@ -68,9 +77,16 @@ def semi_determinize(input,
                      cut_on_scc_entry=False,
                      cut_always=True,
                      bscc_avoid=True,
+                     simulation_pruning=False,
                      preprocess=False,
                      postprocess=True,
-                     output=TGBA):
+                     output=TGBA,
+                     max_states=0,
+                     max_memory=0,
+                     time_limit=0,
+                     parallel_jobs=False,
+                     cutoff_factor=0,
+                     predict_jobs=0):
   if type(input) is str:
     input = spot.automaton(input)
   if type(input) is spot.formula:
@@ -85,12 +101,47 @@ def semi_determinize(input,
   om.set("cut-on-SCC-entry", int(cut_on_scc_entry))
   om.set("cut-always", int(cut_always))
   om.set("bscc-avoid", int(bscc_avoid))
+  om.set("simulation-pruning", int(simulation_pruning))
   om.set("preprocess", int(preprocess))
   om.set("postprocess", int(postprocess))
   om.set("output", int(output))
+  om.set("max-states", int(max_states))
+  om.set("max-memory", int(max_memory))
+  om.set("time-limit", int(time_limit))
+  om.set("parallel-jobs", int(parallel_jobs))
+  om.set("cutoff-factor", int(cutoff_factor))
+  om.set("predict-jobs", int(predict_jobs))
   return semi_determinize_cpp(input, cut_det, jobs, om)
 
 
+def semi_determinize_lazy(input,
+                          cut_det=False,
+                          scc_aware=True,
+                          powerset_for_weak=True,
+                          powerset_on_cut=True,
+                          skip_levels=True,
+                          reuse_deterministic=True,
+                          cut_on_scc_entry=False,
+                          cut_always=True,
+                          bscc_avoid=True,
+                          simulation_pruning=False):
+  if type(input) is str:
+    input = spot.automaton(input)
+  if type(input) is spot.formula:
+    input = input.translate('deterministic', 'tgba')
+  om = spot.option_map()
+  om.set("scc-aware", int(scc_aware))
+  om.set("powerset-for-weak", int(powerset_for_weak))
+  om.set("powerset-on-cut", int(powerset_on_cut))
+  om.set("skip-levels", int(skip_levels))
+  om.set("reuse-deterministic", int(reuse_deterministic))
+  om.set("cut-on-SCC-entry", int(cut_on_scc_entry))
+  om.set("cut-always", int(cut_always))
+  om.set("bscc-avoid", int(bscc_avoid))
+  om.set("simulation-pruning", int(simulation_pruning))
+  return semi_determinize_lazy_cpp(input, cut_det, om)
+
+
 def seminator(input, pure=False, highlight=False,
               complement=False, postprocess_comp=None,
               output=TGBA, **semi_determinize_args):
@@ -0,0 +1,318 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <bitops.hpp>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define SEMINATOR_X86_KERNELS 1
+#  include <immintrin.h>
+#endif
+
+namespace bits
+{
+  namespace
+  {
+    // Scalar kernels
+
+    bool any_scalar(const word* w, size_t nw)
+    {
+      word acc = 0;
+      for (size_t i = 0; i < nw; ++i)
+        acc |= w[i];
+      return acc != 0;
+    }
+
+    bool equal_scalar(const word* a, const word* b, size_t nw)
+    {
+      word diff = 0;
+      for (size_t i = 0; i < nw; ++i)
+        diff |= a[i] ^ b[i];
+      return diff == 0;
+    }
+
+    void or_into_scalar(word* dst, const word* src, size_t nw)
+    {
+      for (size_t i = 0; i < nw; ++i)
+        dst[i] |= src[i];
+    }
+
+    void or_to_scalar(word* dst, const word* a, const word* b, size_t nw)
+    {
+      for (size_t i = 0; i < nw; ++i)
+        dst[i] = a[i] | b[i];
+    }
+
+    bool and_into_scalar(word* dst, const word* mask, size_t nw)
+    {
+      word acc = 0;
+      for (size_t i = 0; i < nw; ++i)
+        acc |= (dst[i] &= mask[i]);
+      return acc != 0;
+    }
+
+    constexpr kernels scalar_kernels = {
+      any_scalar, equal_scalar, or_into_scalar, or_to_scalar, and_into_scalar
+    };
+
+#ifdef SEMINATOR_X86_KERNELS
+    // AVX2 kernels: 4 words per step, the tail is processed by the
+    // scalar kernels.
+
+#  define AVX2 __attribute__((target("avx2")))
+
+    AVX2 bool any_avx2(const word* w, size_t nw)
+    {
+      size_t i = 0;
+      __m256i acc = _mm256_setzero_si256();
+      for (; i + 4 <= nw; i += 4)
+        acc = _mm256_or_si256(acc,
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i)));
+      return !_mm256_testz_si256(acc, acc) || any_scalar(w + i, nw - i);
+    }
+
+    AVX2 bool equal_avx2(const word* a, const word* b, size_t nw)
+    {
+      size_t i = 0;
+      __m256i diff = _mm256_setzero_si256();
+      for (; i + 4 <= nw; i += 4)
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+      return _mm256_testz_si256(diff, diff)
+        && equal_scalar(a + i, b + i, nw - i);
+    }
+
+    AVX2 void or_into_avx2(word* dst, const word* src, size_t nw)
+    {
+      size_t i = 0;
+      for (; i + 4 <= nw; i += 4)
+        {
+          auto d = reinterpret_cast<__m256i*>(dst + i);
+          _mm256_storeu_si256(d, _mm256_or_si256(_mm256_loadu_si256(d),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+        }
+      or_into_scalar(dst + i, src + i, nw - i);
+    }
+
+    AVX2 void or_to_avx2(word* dst, const word* a, const word* b, size_t nw)
+    {
+      size_t i = 0;
+      for (; i + 4 <= nw; i += 4)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+          _mm256_or_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+      or_to_scalar(dst + i, a + i, b + i, nw - i);
+    }
+
+    AVX2 bool and_into_avx2(word* dst, const word* mask, size_t nw)
+    {
+      size_t i = 0;
+      __m256i acc = _mm256_setzero_si256();
+      for (; i + 4 <= nw; i += 4)
+        {
+          auto d = reinterpret_cast<__m256i*>(dst + i);
+          __m256i r = _mm256_and_si256(_mm256_loadu_si256(d),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i)));
+          _mm256_storeu_si256(d, r);
+          acc = _mm256_or_si256(acc, r);
+        }
+      bool tail = and_into_scalar(dst + i, mask + i, nw - i);
+      return !_mm256_testz_si256(acc, acc) || tail;
+    }
+
+#  undef AVX2
+
+    const kernels avx2_kernels = {
+      any_avx2, equal_avx2, or_into_avx2, or_to_avx2, and_into_avx2
+    };
+
+    // AVX-512 kernels: 8 words per step, the tail is processed with a
+    // masked load/store.
+
+#  define AVX512 __attribute__((target("avx512f")))
+
+    AVX512 inline __mmask8 tail_mask(size_t n)
+    {
+      return static_cast<__mmask8>((1u << n) - 1);
+    }
+
+    AVX512 bool any_avx512(const word* w, size_t nw)
+    {
+      size_t i = 0;
+      __m512i acc = _mm512_setzero_si512();
+      for (; i + 8 <= nw; i += 8)
+        acc = _mm512_or_si512(acc, _mm512_loadu_si512(w + i));
+      acc = _mm512_or_si512(acc,
+        _mm512_maskz_loadu_epi64(tail_mask(nw - i), w + i));
+      return _mm512_test_epi64_mask(acc, acc) != 0;
+    }
+
+    AVX512 bool equal_avx512(const word* a, const word* b, size_t nw)
+    {
+      size_t i = 0;
+      for (; i + 8 <= nw; i += 8)
+        if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(a + i),
+                                     _mm512_loadu_si512(b + i)))
+          return false;
+      __mmask8 m = tail_mask(nw - i);
+      return _mm512_mask_cmpneq_epi64_mask(m,
+        _mm512_maskz_loadu_epi64(m, a + i),
+        _mm512_maskz_loadu_epi64(m, b + i)) == 0;
+    }
+
+    AVX512 void or_into_avx512(word* dst, const word* src, size_t nw)
+    {
+      size_t i = 0;
+      for (; i + 8 <= nw; i += 8)
+        _mm512_storeu_si512(dst + i, _mm512_or_si512(
+          _mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+      __mmask8 m = tail_mask(nw - i);
+      _mm512_mask_storeu_epi64(dst + i, m, _mm512_or_si512(
+        _mm512_maskz_loadu_epi64(m, dst + i),
+        _mm512_maskz_loadu_epi64(m, src + i)));
+    }
+
+    AVX512 void or_to_avx512(word* dst, const word* a, const word* b,
+                             size_t nw)
+    {
+      size_t i = 0;
+      for (; i + 8 <= nw; i += 8)
+        _mm512_storeu_si512(dst + i, _mm512_or_si512(
+          _mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+      __mmask8 m = tail_mask(nw - i);
+      _mm512_mask_storeu_epi64(dst + i, m, _mm512_or_si512(
+        _mm512_maskz_loadu_epi64(m, a + i),
+        _mm512_maskz_loadu_epi64(m, b + i)));
+    }
+
+    AVX512 bool and_into_avx512(word* dst, const word* mask, size_t nw)
+    {
+      size_t i = 0;
+      __m512i acc = _mm512_setzero_si512();
+      for (; i + 8 <= nw; i += 8)
+        {
+          __m512i r = _mm512_and_si512(_mm512_loadu_si512(dst + i),
+                                       _mm512_loadu_si512(mask + i));
+          _mm512_storeu_si512(dst + i, r);
+          acc = _mm512_or_si512(acc, r);
+        }
+      __mmask8 m = tail_mask(nw - i);
+      __m512i r = _mm512_and_si512(_mm512_maskz_loadu_epi64(m, dst + i),
+                                   _mm512_maskz_loadu_epi64(m, mask + i));
+      _mm512_mask_storeu_epi64(dst + i, m, r);
+      acc = _mm512_or_si512(acc, r);
+      return _mm512_test_epi64_mask(acc, acc) != 0;
+    }
+
+#  undef AVX512
+
+    const kernels avx512_kernels = {
+      any_avx512, equal_avx512, or_into_avx512, or_to_avx512, and_into_avx512
+    };
+#endif // SEMINATOR_X86_KERNELS
+
+    const kernels* kernels_of(isa level)
+    {
+      switch (level)
+        {
+        case isa::scalar:
+          return &scalar_kernels;
+#ifdef SEMINATOR_X86_KERNELS
+        case isa::avx2:
+          return &avx2_kernels;
+        case isa::avx512:
+          return &avx512_kernels;
+#else
+        default:
+          break;
+#endif
+        }
+      return nullptr;
+    }
+
+    isa best_supported()
+    {
+      if (supported(isa::avx512))
+        return isa::avx512;
+      if (supported(isa::avx2))
+        return isa::avx2;
+      return isa::scalar;
+    }
+
+    isa current = isa::scalar;
+  }
+
+  // Constant-initialized, so that the scalar kernels are usable even
+  // before the dynamic initialization below has run.
+  kernels active = scalar_kernels;
+
+  namespace
+  {
+    const bool dispatched = select(best_supported());
+  }
+
+  bool supported(isa level)
+  {
+    switch (level)
+      {
+      case isa::scalar:
+        return true;
+#ifdef SEMINATOR_X86_KERNELS
+      case isa::avx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+      case isa::avx512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+#else
+      default:
+        break;
+#endif
+      }
+    return false;
+  }
+
+  bool select(isa level)
+  {
+    if (!supported(level))
+      return false;
+    current = level;
+    active = *kernels_of(level);
+    return true;
+  }
+
+  isa selected()
+  {
+    return current;
+  }
+
+  const char* name(isa level)
+  {
+    switch (level)
+      {
+      case isa::scalar:
+        return "scalar";
+      case isa::avx2:
+        return "avx2";
+      case isa::avx512:
+        return "avx512";
+      }
+    return "?";
+  }
+}
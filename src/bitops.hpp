@@ -0,0 +1,171 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Operations on plain arrays of 64-bit words used as bitsets.
+//
+// Unlike spot::bitvect, these arrays can live in caller-owned buffers that
+// are reused from one call to the next, and their words can be processed
+// directly.
+namespace bits
+{
+  typedef uint64_t word;
+
+  inline size_t words_for(size_t nbits)
+  {
+    return (nbits + 63) / 64;
+  }
+
+  inline void set(word* w, size_t i)
+  {
+    w[i / 64] |= word(1) << (i % 64);
+  }
+
+  inline void clear(word* w, size_t i)
+  {
+    w[i / 64] &= ~(word(1) << (i % 64));
+  }
+
+  inline bool test(const word* w, size_t i)
+  {
+    return (w[i / 64] >> (i % 64)) & 1;
+  }
+
+  // Index of the first bit set at a position >= from, or nw*64 if none.
+  inline size_t find_next(const word* w, size_t nw, size_t from)
+  {
+    size_t i = from / 64;
+    if (i >= nw)
+      return nw * 64;
+    word cur = w[i] & (~word(0) << (from % 64));
+    for (;;)
+      {
+        if (cur)
+          return i * 64 + __builtin_ctzll(cur);
+        if (++i == nw)
+          return nw * 64;
+        cur = w[i];
+      }
+  }
+
+  // Word-wise kernels on long bitsets.
+  //
+  // Each kernel exists in a scalar version and, on x86-64, in AVX2 and
+  // AVX-512 versions. The best version supported by the running CPU is
+  // selected once at startup. Short bitsets (up to `short_words` words,
+  // i.e. automata with at most 256 states) are processed inline, as the
+  // indirect call would cost more than it saves.
+  enum class isa { scalar, avx2, avx512 };
+
+  struct kernels
+  {
+    bool (*any)(const word* w, size_t nw);
+    bool (*equal)(const word* a, const word* b, size_t nw);
+    void (*or_into)(word* dst, const word* src, size_t nw);
+    void (*or_to)(word* dst, const word* a, const word* b, size_t nw);
+    bool (*and_into)(word* dst, const word* mask, size_t nw);
+  };
+
+  extern kernels active;
+
+  // Whether the running CPU supports `level`
+  bool supported(isa level);
+  // Switches to the kernels of `level`; returns false (and changes
+  // nothing) if the CPU does not support it.
+  bool select(isa level);
+  // The level of the kernels in use
+  isa selected();
+  const char* name(isa level);
+
+  const size_t short_words = 4;
+
+  inline bool any(const word* w, size_t nw)
+  {
+    if (nw > short_words)
+      return active.any(w, nw);
+    for (size_t i = 0; i < nw; ++i)
+      if (w[i])
+        return true;
+    return false;
+  }
+
+  inline bool equal(const word* a, const word* b, size_t nw)
+  {
+    if (nw > short_words)
+      return active.equal(a, b, nw);
+    for (size_t i = 0; i < nw; ++i)
+      if (a[i] != b[i])
+        return false;
+    return true;
+  }
+
+  inline void copy(word* dst, const word* src, size_t nw)
+  {
+    for (size_t i = 0; i < nw; ++i)
+      dst[i] = src[i];
+  }
+
+  inline void fill_zero(word* dst, size_t nw)
+  {
+    for (size_t i = 0; i < nw; ++i)
+      dst[i] = 0;
+  }
+
+  inline void or_into(word* dst, const word* src, size_t nw)
+  {
+    if (nw > short_words)
+      return active.or_into(dst, src, nw);
+    for (size_t i = 0; i < nw; ++i)
+      dst[i] |= src[i];
+  }
+
+  // dst = a | b
+  inline void or_to(word* dst, const word* a, const word* b, size_t nw)
+  {
+    if (nw > short_words)
+      return active.or_to(dst, a, b, nw);
+    for (size_t i = 0; i < nw; ++i)
+      dst[i] = a[i] | b[i];
+  }
+
+  // dst &= mask; returns whether dst is not empty afterwards
+  inline bool and_into(word* dst, const word* mask, size_t nw)
+  {
+    if (nw > short_words)
+      return active.and_into(dst, mask, nw);
+    word acc = 0;
+    for (size_t i = 0; i < nw; ++i)
+      acc |= (dst[i] &= mask[i]);
+    return acc != 0;
+  }
+
+  // Bitset of `nbits` bits with the positions in [begin, end) set
+  template <class Iterator>
+  std::vector<word> from_range(size_t nbits, Iterator begin, Iterator end)
+  {
+    std::vector<word> res(words_for(nbits), 0);
+    for (auto i = begin; i != end; ++i)
+      set(res.data(), *i);
+    return res;
+  }
+}
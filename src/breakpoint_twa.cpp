@@ -17,17 +17,21 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
+#include <algorithm>
+#include <memory>
 
 #include <types.hpp>
 #include <breakpoint_twa.hpp>
 #include <cutdet.hpp>
+#include <parallel.hpp>
 
-std::string bp_name(breakpoint_state bps) {
-  state_set p = std::get<Bp::P>(bps);
-  state_set q = std::get<Bp::Q>(bps);
-  int level   = std::get<Bp::LEVEL>(bps);
+std::string bp_name(const state_set_table& sets, breakpoint_state bps) {
+  set_id p  = std::get<Bp::P>(bps);
+  set_id q  = std::get<Bp::Q>(bps);
+  int level = std::get<Bp::LEVEL>(bps);
   std::stringstream name;
-  name << powerset_name(&p) << " , " << powerset_name(&q) << " , " << level;
+  name << powerset_name(sets, p) << " , " << powerset_name(sets, q)
+       << " , " << level;
   return name.str();
 }
 
@@ -49,24 +53,54 @@ bp_twa::names() {
 
 state_t
 bp_twa::bp_state(breakpoint_state bps) {
-  auto loc = bp2num_.lower_bound(bps);
-  if (loc != bp2num_.end() && loc->first == bps)
-    return loc->second;         // existing state
+  state_t found = bp2num_.get(bps);
+  if (found != breakpoint_map::none)
+    return found;               // existing state
 
   // create a new state
   assert(num2bp_.size() == res_->num_states());
-  unsigned result = res_->new_state();
-  bp2num_.emplace_hint(loc, bps, result);
+  unsigned result = new_state();
+  bp2num_.insert(bps, result);
 
   // Update the state vectors to correct size
   num2bp_.emplace_back(bps);
   num2ps2_.resize(num2bp_.size());
   //TODO add to bp2 states
 
-  names_->emplace_back(bp_name(bps));
+  names_->emplace_back(bp_name(sets_, bps));
   return result;
 }
 
+state_t
+bp_twa::new_state() {
+  state_t res = res_->new_state();
+  if ((res & 255) == 0)
+    budget_->check(res_->num_states(), memory_usage());
+  return res;
+}
+
+size_t
+bp_twa::memory_usage() const {
+  size_t res = sets_.memory_usage() + psb_->memory_usage();
+  res += bp2num_.memory_usage() + ps2num1_.memory_usage()
+    + ps2num2_.memory_usage();
+  res += num2bp_.capacity() * sizeof(breakpoint_state);
+  res += (num2ps1_.capacity() + num2ps2_.capacity()) * sizeof(set_id);
+  res += names_->capacity() * sizeof(std::string);
+  res += res_->num_edges() * sizeof(edge_t);
+  if (sim_)
+    res += sim_->memory_usage();
+  return res;
+}
+
+void
+bp_twa::reserve(size_t n) {
+  bp2num_.reserve(n);
+  num2bp_.reserve(n);
+  num2ps2_.reserve(n);
+  names_->reserve(n);
+}
+
 state_t
 bp_twa::reuse_state(state_t old) {
   auto result_it = old2new2_.find(old);
@@ -76,12 +110,12 @@ bp_twa::reuse_state(state_t old) {
     return result_it->second;
 
   // else create a new state
-  unsigned result = res_->new_state();
+  unsigned result = new_state();
   new2old2_[result] = old;
   old2new2_[old] = result;
 
   // Update the vector maps to be of the correct size
-  num2ps2_.emplace_back(empty_set);
+  num2ps2_.emplace_back(state_set_table::empty_id);
   num2bp_.emplace_back(breakpoint_state());
   //TODO add to bp2 states
 
@@ -91,14 +125,14 @@ bp_twa::reuse_state(state_t old) {
 
 // _s a new state if needed
 state_t
-bp_twa::ps_state(state_set ps, bool fc) {
+bp_twa::ps_state(set_id ps, bool fc) {
   // fc = first component
   auto num2ps = fc ? &num2ps1_ : &num2ps2_;
   auto ps2num = fc ? &ps2num1_ : &ps2num2_;
 
-  auto loc = ps2num->lower_bound(ps);
-  if (loc != ps2num->end() && loc->first == ps)
-    return loc->second;         // existing state
+  state_t found = ps2num->get(ps);
+  if (found != power_map::none)
+    return found;               // existing state
 
   // create a new state
   assert(num2ps->size() == res_->num_states());
@@ -106,28 +140,35 @@ bp_twa::ps_state(state_set ps, bool fc) {
   if (!fc) {
     num2bp_.resize(num2ps2_.size());
   }
-  auto state = res_->new_state();
-  ps2num->emplace_hint(loc, ps, state);
+  auto state = new_state();
+  ps2num->insert(ps, state);
   //TODO add to bp1 states
 
-  names_->emplace_back(powerset_name(&ps));
+  names_->emplace_back(powerset_name(sets_, ps));
   return state;
 };
 
 void
 bp_twa::create_all_cut_transitions() {
+  // in cDBA, index the states of the 1st component by the input states
+  // they contain (in increasing order)
+  std::vector<state_vect> containing;
+  if (cut_det_) {
+    containing.resize(src_->num_states());
+    for (state_t s = 0; s < num2ps1_.size(); ++s)
+      for (auto it = sets_.begin(num2ps1_[s]); it != sets_.end(num2ps1_[s]);
+           ++it)
+        containing[*it].push_back(s);
+  }
+
   for (auto& edge : src_->edges())
   {
     if (cut_condition(edge))
     {
       if (cut_det_) {
         // in cDBA, add cut-edge from each state that contains edge.src
-        for (unsigned s = 0; s < ps2num1_.size(); ++s) {
-          // Can we iterate over keys of ps2num1_?
-          state_set * current_states = &(num2ps1_.at(s));
-          if (current_states->count(edge.src))
-            add_cut_transition(s, edge);
-        }
+        for (state_t s: containing[edge.src])
+          add_cut_transition(s, edge);
       } else {// in sDBA add (s, cond, dest)
         add_cut_transition(edge.src, edge);
       }
@@ -137,10 +178,8 @@ bp_twa::create_all_cut_transitions() {
 
 // This is to be used for reused SCC during --reuse-deterministic
 // Basicaly only copies the edges
-template <> void
-bp_twa::compute_successors<state_t>(state_t old, state_t src,
-  state_vect * intersection,
-  bool fc, bdd cond_constrain)
+void
+bp_twa::copy_reused_successors(state_t old, state_t src)
 {
   assert(src == old2new2_[old]);
   assert(old == new2old2_[src]);
@@ -157,30 +196,46 @@ bp_twa::compute_successors<state_t>(state_t old, state_t src,
 // cut-deterministic automata (the fc switch)
 // The edges in 2nd component are all accepting
 // No edges are accepting in the first component
-template <> void
-bp_twa::compute_successors<state_set>(state_set ps, state_t src,
-  state_vect * intersection,
-  bool fc, bdd cond_constrain)
+void
+bp_twa::compute_edges(const powerset_builder& psb,
+                      set_id ps, const bits::word* intersection,
+                      succ_scratch& scratch, succ_record& out) const
 {
-  assert(ps != empty_set);
+  assert(ps != state_set_table::empty_id);
 
-  auto succs = psb_->get_succs<>(&ps, intersection->begin(), intersection->end());
-  for(size_t c = 0; c < psb_->nc_; ++c) {
-    auto cond = psb_->num2bdd_[c];
-    if (!bdd_implies(cond, cond_constrain))
-      continue;
-    auto d_ps = succs->at(c);
-    // Skip transitions to ∅
-    if (d_ps == empty_set)
-      continue;
-    auto dst = ps_state(d_ps, fc);
-    acc_mark mark = acc_mark();
-    if (!fc)
-      mark = acc_mark(acc_mark_);
-    res_->new_edge(src, dst, cond, mark);
+  out.edges.clear();
+  out.words.clear();
+  psb.succs(ps, intersection, scratch.p);
+  size_t nw = scratch.p.nw;
+  // Transitions to ∅ are skipped
+  for (unsigned c = scratch.p.next(0); c < psb.nc_;
+       c = scratch.p.next(c + 1))
+  {
+    out.edges.push_back({c, 0, false});
+    const bits::word* row = scratch.p.row(c);
+    out.words.insert(out.words.end(), row, row + nw);
   }
 }
 
+void
+bp_twa::commit_ps_edges(state_t src, const succ_record& rec,
+                        bool fc, bdd cond_constrain)
+{
+  edges_.clear();
+  append_edges(rec, true, fc, cond_constrain, edges_);
+  for (auto& e: edges_)
+    res_->new_edge(src, state_of(e.dst), e.cond, e.acc);
+}
+
+template <> void
+bp_twa::compute_successors<set_id>(set_id ps, state_t src,
+  const bits::word* intersection,
+  bool fc, bdd cond_constrain)
+{
+  compute_edges(*psb_, ps, intersection, scratch_, record_);
+  commit_ps_edges(src, record_, fc, cond_constrain);
+}
+
 void
 bp_twa::create_first_component()
 {
@@ -189,10 +244,10 @@ bp_twa::create_first_component()
     state_t num = res_->new_state();
     res_->set_init_state(num);
     state_t init_num = src_->get_init_state_number();
-    state_set ps{init_num};
-    ps2num1_[ps] = num;
+    set_id ps = sets_.intern(&init_num, &init_num + 1);
+    ps2num1_.insert(ps, num);
     num2ps1_.emplace_back(ps);
-    names_->emplace_back(powerset_name(&ps));
+    names_->emplace_back(powerset_name(sets_, ps));
 
     assert(!bscc_avoid_ || !bscc_avoid_->avoid_state(init_num));
 
@@ -207,11 +262,13 @@ bp_twa::create_first_component()
                          src_si_.states_of(scc).begin(),
                          src_si_.states_of(scc).end());
     }
+    first_comp_mask_ = psb_->state_mask(not_avoided.begin(),
+                                        not_avoided.end());
 
     for (state_t src = 0; src < res_->num_states(); ++src)
     {
       auto ps = num2ps1_.at(src);
-      compute_successors(ps, src, &not_avoided, true);
+      compute_successors(ps, src, first_comp_mask_.data(), true);
     }
     res_->merge_edges();
   } else { // Just copy the states and transitions
@@ -232,128 +289,250 @@ bp_twa::create_first_component()
       res_->new_edge(e.src, e.dst, e.cond);
     }
   }
-  res_->set_named_prop("state-names", names_);
+  res_->set_named_prop("state-names", own_names_.release());
 }
 
-template <> void
-bp_twa::compute_successors<breakpoint_state>(breakpoint_state bps, state_t src,
-  state_vect * intersection,
-  bool fc, bdd cond_constrain)
+void
+bp_twa::compute_edges(const powerset_builder& psb,
+                      breakpoint_state bps, const bits::word* intersection,
+                      bool fc, const direct_simulation* sim,
+                      succ_scratch& scratch, succ_record& out) const
 {
-  state_set p = std::get<Bp::P>(bps);
-  state_set q = std::get<Bp::Q>(bps);
-  int k       = std::get<Bp::LEVEL>(bps);
+  set_id p = std::get<Bp::P>(bps);
+  set_id q = std::get<Bp::Q>(bps);
+  int k    = std::get<Bp::LEVEL>(bps);
 
-  assert(p != empty_set);
+  assert(p != state_set_table::empty_id);
   //assert(!fc);
 
-  succ_vect_ptr p_succs   (psb_->get_succs(&p,
-                          intersection->begin(), intersection->end()));
-  succ_vect_ptr q_succs   (psb_->get_succs(&q,
-                          intersection->begin(), intersection->end()));
-  succ_vect_ptr p_k_succs (psb_->get_succs(&p, k, // go to Q
-                          intersection->begin(), intersection->end()));
+  out.edges.clear();
+  out.words.clear();
+  // Successors of P for all levels at once, so that skipping levels
+  // below only compares and copies rows
+  psb.succs_by_mark(p, intersection, scratch.p, scratch.marked);
+  psb.succs(q, intersection, scratch.q);
+
+  size_t nw = scratch.p.nw;
+  unsigned levels = scratch.marked.size();
+  // The l-successors of P under the condition c (all successors if l is
+  // not a mark)
+  auto level_row = [&](unsigned l, unsigned c)
+    {
+      return l < levels ? scratch.marked[l].row(c) : scratch.p.row(c);
+    };
 
-  for(size_t c = 0; c < psb_->nc_; ++c)
+  // Skip transitions to ∅
+  for (unsigned c = scratch.p.next(0); c < psb.nc_;
+       c = scratch.p.next(c + 1))
   {
-    bdd cond = psb_->num2bdd_[c];
+    // P' and Q' of the edge are stored next to each other
+    size_t at = out.words.size();
+    out.words.resize(at + 2 * nw);
+    bits::word* p2 = out.words.data() + at;
+    bits::word* q2 = p2 + nw;
+    bits::copy(p2, scratch.p.row(c), nw);
+    bits::or_to(q2, scratch.q.row(c), level_row(k, c), nw); // go to Q
 
-    // don't build edges not satisfying cond_constraint
-    if (!bdd_implies(cond, cond_constrain))
-      continue;
-    auto p2   = p_succs->at(c);
-    auto q2   = q_succs->at(c);
-    auto p2_k = p_k_succs->at(c); // go to Q
-    q2.insert(p2_k.begin(),p2_k.end());
-    // Skip transitions to ∅
-    if (p2 == empty_set)
-      continue;
+    // Prune P' according to the current Q' (which changes with the level)
+    auto prune = [&]()
+      {
+        if (!sim)
+          return;
+        bits::copy(p2, scratch.p.row(c), nw);
+        sim->prune(p2, q2, scratch.drop);
+      };
+    prune();
 
     auto k2 = k;
     // Check p == q
-    auto acc = spot::acc_cond::mark_t();
+    bool acc = false;
 
     do
     {
-      if (!fc && p2 == q2) {
+      if (!fc && bits::equal(p2, q2, nw)) {
         k2 = (k2 + 1) % src_->num_sets();
-        acc = acc_mark_;
+        acc = true;
         // Take the k2-succs of p
-        succ_vect_ptr tmp (psb_->get_succs(&p, k2,
-                          intersection->begin(), intersection->end()));
-        q2 = tmp->at(c);
+        bits::copy(q2, level_row(k2, c), nw);
+        prune();
       } else
         break;
     } while ((k2 != k) && skip_levels_);
 
-    // keep Q empty if all breakpoints were reached
-    if (p2 == q2)
-      q2 = empty_set;
+    out.edges.push_back({c, unsigned(k2), acc});
+  }
+}
+
+void
+bp_twa::commit_bp_edges(state_t src, const succ_record& rec,
+                        bdd cond_constrain)
+{
+  edges_.clear();
+  append_edges(rec, false, false, cond_constrain, edges_);
+  for (auto& e: edges_)
+    res_->new_edge(src, state_of(e.dst), e.cond, e.acc);
+}
+
+void
+bp_twa::append_edges(const succ_record& rec, bool powerset, bool fc,
+                     bdd cond_constrain, std::vector<sd_edge>& out)
+{
+  size_t nw = psb_->state_words();
+  size_t stride = powerset ? nw : 2 * nw;
+  for (size_t i = 0; i < rec.edges.size(); ++i)
+  {
+    auto& e = rec.edges[i];
+    bdd cond = psb_->num2bdd_[e.cond];
 
-    // Construct the breakpoint_state. We use get just to be error-prone
-    breakpoint_state bpd;
-    std::get<Bp::LEVEL>(bpd) = k2;
-    std::get<Bp::P>    (bpd) = p2;
-    std::get<Bp::Q>    (bpd) = q2;
+    // don't build edges not satisfying cond_constraint
+    if (!bdd_implies(cond, cond_constrain))
+      continue;
+    const bits::word* p2 = rec.words.data() + i * stride;
 
-    auto dst = bp_state(bpd);
-    res_->new_edge(src, dst, cond, acc);
+    sd_state dst;
+    dst.p = sets_.intern_bits(p2, nw);
+    acc_mark acc = acc_mark();
+    if (powerset)
+    {
+      // No edges are accepting in the first component
+      dst.type = fc ? State_type::PS1 : State_type::PS2;
+      if (!fc)
+        acc = acc_mark_;
+    }
+    else
+    {
+      // keep Q empty if all breakpoints were reached
+      const bits::word* q2 = p2 + nw;
+      dst.type = State_type::BP2;
+      dst.level = e.level;
+      if (!bits::equal(p2, q2, nw))
+        dst.q = sets_.intern_bits(q2, nw);
+      if (e.acc)
+        acc = acc_mark_;
+    }
+    out.push_back({cond, dst, acc});
+  }
+}
+
+state_t
+bp_twa::state_of(const sd_state& st)
+{
+  switch (st.type)
+  {
+    case State_type::SIMPLE1:
+      return st.s;
+    case State_type::PS1:
+      return ps_state(st.p, true);
+    case State_type::PS2:
+      return ps_state(st.p, false);
+    case State_type::BP2:
+      return bp_state(breakpoint_state(st.level, st.p, st.q));
+    case State_type::REUSED2:
+      return reuse_state(st.s);
   }
+  assert(!"should not be reached");
+  return 0;
+}
+
+template <> void
+bp_twa::compute_successors<breakpoint_state>(breakpoint_state bps, state_t src,
+  const bits::word* intersection,
+  bool fc, bdd cond_constrain)
+{
+  compute_edges(*psb_, bps, intersection, fc, pruning(intersection),
+                scratch_, record_);
+  commit_bp_edges(src, record_, cond_constrain);
+}
+
+void
+bp_twa::add_cut_transition(state_t from, const edge_t& edge) {
+  for (auto& e: cached_cut_successors(edge))
+    res_->new_edge(from, state_of(e.dst), e.cond, e.acc);
+}
+
+const std::vector<sd_edge>&
+bp_twa::cached_cut_successors(const edge_t& edge) {
+  unsigned num = src_->edge_number(edge);
+  if (cut_cache_.empty())
+    cut_cache_.resize(src_->get_graph().edge_vector().size());
+  auto& res = cut_cache_[num];
+  if (!res)
+  {
+    res.reset(new std::vector<sd_edge>);
+    cut_successors(edge, *res);
+  }
+  return *res;
 }
 
 void
-bp_twa::add_cut_transition(state_t from, edge_t edge) {
+bp_twa::cut_successors(const edge_t& edge, std::vector<sd_edge>& out) {
 
   auto scc = src_si_.scc_of(edge.dst);
   bool weak = src_si_.weak_sccs()[scc];
   bool reuse = bscc_avoid_ && bscc_avoid_->avoid_scc(scc);
 
-  state_vect scc_states;
-  if (scc_aware_)
-    scc_states = src_si_.states_of(scc);
+  const bits::word* scc_states = scc_aware_ ? scc_mask(scc) : nullptr;
 
-  state_t target_state;
+  sd_state target;
 
   if (reuse_SCC_ && reuse)
   {
-    res_->new_edge(from, reuse_state(edge.dst), edge.cond);
+    target.type = State_type::REUSED2;
+    target.s = edge.dst;
+    out.push_back({edge.cond, target, acc_mark()});
     return;
   }
 
   if (!powerset_on_cut_)
   {
     // create the target state
-    state_set new_set{edge.dst};
+    target.p = sets_.intern(&edge.dst, &edge.dst + 1);
     if (powerset_for_weak_ && weak && !(reuse && bscc_avoid_))
-      target_state = ps_state(new_set, false);
+      target.type = State_type::PS2;
     else
-    {
       // (level, P=new_set, Q=∅)
-      breakpoint_state dest(0, new_set, empty_set);
-      target_state = bp_state(dest);
-    }
-    res_->new_edge(from, target_state, edge.cond);
+      target.type = State_type::BP2;
+    out.push_back({edge.cond, target, acc_mark()});
   } else {
-    state_set start({edge.src});
+    set_id start = sets_.intern(&edge.src, &edge.src + 1);
     if (powerset_for_weak_ && weak && !(reuse && bscc_avoid_))
-      compute_successors(start, from, &scc_states, false, edge.cond);
+    {
+      compute_edges(*psb_, start, scc_states, scratch_, record_);
+      append_edges(record_, true, false, edge.cond, out);
+    }
     else
     {
       breakpoint_state bps;
       std::get<Bp::LEVEL>(bps) = 0;
       std::get<Bp::P>    (bps) = start;
-      std::get<Bp::Q>    (bps) = empty_set;
-      compute_successors(bps, from, &scc_states, true, edge.cond);
+      std::get<Bp::Q>    (bps) = state_set_table::empty_id;
+      compute_edges(*psb_, bps, scc_states, true, nullptr,
+                    scratch_, record_);
+      append_edges(record_, false, false, edge.cond, out);
     }
   }
 }
 
-state_vect
-bp_twa::get_and_check_scc(state_set ps) {
-  state_vect intersection;
+const bits::word*
+bp_twa::scc_mask(unsigned scc)
+{
+  if (scc_masks_.empty())
+    scc_masks_.resize(src_si_.scc_count());
+  auto& mask = scc_masks_[scc];
+  if (mask.empty())
+  {
+    auto& states = src_si_.states_of(scc);
+    mask = psb_->state_mask(states.begin(), states.end());
+  }
+  return mask.data();
+}
+
+const bits::word*
+bp_twa::get_and_check_scc(set_id ps) {
+  const bits::word* intersection = nullptr;
   if (scc_aware_)
   { // create set of states from current SCC
-    auto scc = src_si_.scc_of(*(ps.begin()));
+    auto scc = src_si_.scc_of(*sets_.begin(ps));
 
     // For the bottom-SCC optimization we have to be carefull.
     // The components C that are in the cut (already satisfy the semi-det
@@ -363,34 +542,439 @@ bp_twa::get_and_check_scc(state_set ps) {
     if (bscc_avoid_ && bscc_avoid_->avoid_scc(scc))
       return intersection;
 
-    for (auto s : ps)
-      assert(src_si_.scc_of(s) == scc);
-    intersection = src_si_.states_of(scc);
+    for (auto it = sets_.begin(ps); it != sets_.end(ps); ++it)
+      assert(src_si_.scc_of(*it) == scc);
+    intersection = scc_mask(scc);
   }
   return intersection;
 }
 
 void
 bp_twa::finish_second_component(state_t start) {
+  if (scc_decompose_ && scc_aware_)
+    build_scc_pieces(start);
+  if (threads_ > 1)
+    return finish_second_component_parallel(start);
+
   for (state_t src = start; src < res_->num_states(); ++src)
   {
+    if (expanded(src))
+      continue;
     // Resolve the type of state and run compute_successors
     auto ps = num2ps2_.at(src);
-    if (ps == empty_set)
+    if (ps == state_set_table::empty_id)
       if (new2old2_.find(src) != new2old2_.end())
-        compute_successors<state_t>(new2old2_[src], src);
+        copy_reused_successors(new2old2_[src], src);
       else
       { // breakpoint
         auto bps = num2bp_.at(src);
         auto intersection = get_and_check_scc(std::get<Bp::P>(bps));
-        compute_successors(bps, src, &intersection);
+        compute_successors(bps, src, intersection);
       }
     else
     { // powerset
       auto intersection = get_and_check_scc(ps);
-      compute_successors(ps, src, &intersection);
+      compute_successors(ps, src, intersection);
+    }
+  }
+}
+
+// The states are processed in batches of consecutive states. The
+// successors of all states of a batch are computed concurrently; this only
+// reads psb_ and sets_. Then the batch is committed state by state, in
+// order, which interns the sets and creates the new states and edges
+// exactly as the sequential loop does. The result does not depend on the
+// number of threads.
+void
+bp_twa::finish_second_component_parallel(state_t start) {
+  // Bounds the memory used by the successors of one batch
+  const state_t max_batch = 1 << 14;
+
+  enum class kind { reused, breakpoint, powerset, expanded };
+  struct task
+  {
+    kind type;
+    const bits::word* intersection;
+  };
+
+  worker_pool pool(threads_);
+  std::vector<succ_scratch> scratch(pool.size());
+  std::vector<succ_record> records;
+  std::vector<task> tasks;
+
+  for (state_t next = start; next < res_->num_states();)
+  {
+    state_t end = std::min<state_t>(res_->num_states(), next + max_batch);
+
+    // Resolve the type of states (serially, as scc_mask() fills a cache)
+    tasks.clear();
+    for (state_t src = next; src < end; ++src)
+    {
+      auto ps = num2ps2_.at(src);
+      if (expanded(src))
+        tasks.push_back({kind::expanded, nullptr});
+      else if (ps != state_set_table::empty_id)
+        tasks.push_back({kind::powerset, get_and_check_scc(ps)});
+      else if (new2old2_.find(src) != new2old2_.end())
+        tasks.push_back({kind::reused, nullptr});
+      else
+        tasks.push_back({kind::breakpoint,
+              get_and_check_scc(std::get<Bp::P>(num2bp_.at(src)))});
+    }
+
+    if (records.size() < tasks.size())
+      records.resize(tasks.size());
+    pool.run(tasks.size(), [&](size_t i, unsigned t) {
+        state_t src = next + i;
+        switch (tasks[i].type)
+        {
+          case kind::breakpoint:
+            compute_edges(*psb_, num2bp_[src], tasks[i].intersection, false,
+                          pruning(tasks[i].intersection),
+                          scratch[t], records[i]);
+            break;
+          case kind::powerset:
+            compute_edges(*psb_, num2ps2_[src], tasks[i].intersection,
+                          scratch[t], records[i]);
+            break;
+          case kind::reused:
+          case kind::expanded:
+            break;
+        }
+      });
+
+    for (state_t src = next; src < end; ++src)
+    {
+      auto& rec = records[src - next];
+      switch (tasks[src - next].type)
+      {
+        case kind::breakpoint:
+          commit_bp_edges(src, rec);
+          break;
+        case kind::powerset:
+          commit_ps_edges(src, rec, false);
+          break;
+        case kind::reused:
+          copy_reused_successors(new2old2_[src], src);
+          break;
+        case kind::expanded:
+          break;
+      }
     }
+    next = end;
+  }
+}
+
+// The part of the 2nd component confined to one SCC of src_, built on its
+// own by build_scc_pieces().
+//
+// The states of the SCC are renumbered 0..n-1 (in increasing order, so
+// that sorted sets stay sorted) and the piece uses a powerset builder for
+// the SCC alone: its bitsets have n bits and its letter classes only
+// separate the labels used inside the SCC. The states of the piece are
+// kept in `states` with their local sets; ps[i] tells whether state i is
+// a powerset state. The first `entries.size()` states are the entry states,
+// which already exist in res_.
+struct bp_twa::scc_piece
+{
+  struct edge
+  {
+    unsigned src;
+    unsigned cond;
+    unsigned dst;
+    bool acc;
+  };
+
+  unsigned scc;
+  std::vector<state_t> global_of;      // local state -> state of src_
+  aut_ptr aut;                         // the SCC alone
+  state_set_table sets;                // local sets of states
+  std::unique_ptr<powerset_builder> psb;
+  std::unique_ptr<direct_simulation> sim; // with simulation-pruning
+  std::vector<breakpoint_state> states;
+  std::vector<bool> ps;
+  breakpoint_map bp2num;
+  power_map ps2num;
+  std::vector<state_t> entries;        // entry states in res_
+  std::vector<edge> edges;             // in the order of their sources
+
+  // The local state for `bps` (only P matters for powerset states),
+  // created if needed
+  unsigned local_state(const breakpoint_state& bps, bool powerset)
+  {
+    set_id p = std::get<Bp::P>(bps);
+    unsigned found = powerset ? ps2num.get(p) : bp2num.get(bps);
+    if (found != breakpoint_map::none)
+      return found;
+    unsigned res = states.size();
+    if (powerset)
+      ps2num.insert(p, res);
+    else
+      bp2num.insert(bps, res);
+    states.push_back(bps);
+    ps.push_back(powerset);
+    return res;
+  }
+};
+
+void
+bp_twa::explore_scc_piece(scc_piece& piece, std::atomic<size_t>& built,
+                          succ_scratch& scratch, succ_record& rec) const
+{
+  auto& psb = *piece.psb;
+  size_t nw = psb.state_words();
+  // The piece only has the edges of its SCC
+  if (simulation_pruning_)
+    piece.sim.reset(new direct_simulation(psb));
+  // The entries are already counted in res_
+  size_t counted = piece.entries.size();
+  for (unsigned s = 0; s < piece.states.size(); ++s)
+  {
+    if ((s & 255) == 0)
+    {
+      size_t total = built += piece.states.size() - counted;
+      counted = piece.states.size();
+      budget_->check(total,
+                     piece.sets.memory_usage() + psb.memory_usage()
+                     + piece.bp2num.memory_usage()
+                     + piece.edges.capacity() * sizeof(scc_piece::edge));
+    }
+    breakpoint_state bps = piece.states[s];
+    bool powerset = piece.ps[s];
+    if (powerset)
+      compute_edges(psb, std::get<Bp::P>(bps), nullptr, scratch, rec);
+    else
+      compute_edges(psb, bps, nullptr, false, piece.sim.get(), scratch, rec);
+    size_t stride = powerset ? nw : 2 * nw;
+    for (size_t i = 0; i < rec.edges.size(); ++i)
+    {
+      auto& e = rec.edges[i];
+      const bits::word* p2 = rec.words.data() + i * stride;
+      breakpoint_state dst(e.level, piece.sets.intern_bits(p2, nw),
+                           state_set_table::empty_id);
+      if (!powerset && !bits::equal(p2, p2 + nw, nw))
+        std::get<Bp::Q>(dst) = piece.sets.intern_bits(p2 + nw, nw);
+      unsigned d = piece.local_state(dst, powerset);
+      piece.edges.push_back({s, e.cond, d, powerset || e.acc});
+    }
+  }
+}
+
+void
+bp_twa::build_scc_pieces(state_t start) {
+  // Index of each state of src_ in its SCC
+  std::vector<unsigned> local_of(src_->num_states());
+  std::vector<int> piece_of(src_si_.scc_count(), -1);
+  std::vector<std::unique_ptr<scc_piece>> pieces;
+  state_vect buf;
+
+  auto to_local = [&](set_id id) {
+    buf.clear();
+    for (auto it = sets_.begin(id); it != sets_.end(id); ++it)
+      buf.push_back(local_of[*it]);
+    return buf;
+  };
+
+  // Collect the entry states of each SCC
+  for (state_t src = start; src < res_->num_states(); ++src)
+  {
+    if (new2old2_.find(src) != new2old2_.end())
+      continue;
+    set_id ps = num2ps2_.at(src);
+    breakpoint_state bps = ps != state_set_table::empty_id
+      ? breakpoint_state(0, ps, state_set_table::empty_id)
+      : num2bp_.at(src);
+    set_id p = std::get<Bp::P>(bps);
+    if (!get_and_check_scc(p))
+      continue; // not confined to its SCC
+    unsigned scc = src_si_.scc_of(*sets_.begin(p));
+
+    if (piece_of[scc] < 0)
+    {
+      piece_of[scc] = pieces.size();
+      pieces.emplace_back(new scc_piece);
+      auto& piece = *pieces.back();
+      piece.scc = scc;
+      auto& states = src_si_.states_of(scc);
+      piece.global_of.assign(states.begin(), states.end());
+      std::sort(piece.global_of.begin(), piece.global_of.end());
+      unsigned n = piece.global_of.size();
+      for (unsigned l = 0; l < n; ++l)
+        local_of[piece.global_of[l]] = l;
+
+      // The SCC as an automaton of its own
+      piece.aut = spot::make_twa_graph(src_->get_dict());
+      piece.aut->copy_ap_of(src_);
+      piece.aut->set_acceptance(src_->get_acceptance());
+      piece.aut->new_states(n);
+      for (state_t s: piece.global_of)
+        for (auto& e: src_->out(s))
+          if (src_si_.scc_of(e.dst) == scc)
+            piece.aut->new_edge(local_of[e.src], local_of[e.dst],
+                                e.cond, e.acc);
+      piece.psb.reset(new powerset_builder(piece.aut, piece.sets, true,
+                                           budget_));
+    }
+
+    auto& piece = *pieces[piece_of[scc]];
+    bool powerset = ps != state_set_table::empty_id;
+    set_id q = std::get<Bp::Q>(bps);
+    breakpoint_state local(std::get<Bp::LEVEL>(bps),
+                           piece.sets.intern(to_local(p)),
+                           q == state_set_table::empty_id
+                             ? state_set_table::empty_id
+                             : piece.sets.intern(to_local(q)));
+    unsigned l = piece.local_state(local, powerset);
+    assert(l == piece.entries.size());
+    (void) l;
+    piece.entries.push_back(src);
+  }
+
+  // Explore the pieces; they share nothing but the (read-only) options
+  // and the number of states built, which is checked against the budget
+  {
+    worker_pool pool(threads_);
+    std::vector<succ_scratch> scratch(pool.size());
+    std::vector<succ_record> records(pool.size());
+    std::atomic<size_t> built(res_->num_states());
+    pool.run(pieces.size(), [&](size_t i, unsigned t) {
+        explore_scc_piece(*pieces[i], built, scratch[t], records[t]);
+      });
+  }
+
+  // Stitch the pieces into res_, in the order of SCCs of their entries
+  std::vector<state_t> global;
+  for (auto& pp: pieces)
+  {
+    auto& piece = *pp;
+    global.assign(piece.entries.begin(), piece.entries.end());
+    auto to_global = [&](set_id id) {
+      buf.clear();
+      for (auto it = piece.sets.begin(id); it != piece.sets.end(id); ++it)
+        buf.push_back(piece.global_of[*it]);
+      return sets_.intern(buf);
+    };
+    for (unsigned s = piece.entries.size(); s < piece.states.size(); ++s)
+    {
+      auto& bps = piece.states[s];
+      set_id p = to_global(std::get<Bp::P>(bps));
+      if (piece.ps[s])
+        global.push_back(ps_state(p));
+      else
+      {
+        set_id q = std::get<Bp::Q>(bps);
+        if (q != state_set_table::empty_id)
+          q = to_global(q);
+        global.push_back(bp_state(breakpoint_state(std::get<Bp::LEVEL>(bps),
+                                                   p, q)));
+      }
+    }
+    expanded_.resize(res_->num_states());
+    for (state_t g: global)
+      expanded_[g] = true;
+    for (auto& e: piece.edges)
+      res_->new_edge(global[e.src], global[e.dst],
+                     piece.psb->num2bdd_[e.cond],
+                     e.acc ? acc_mark_ : acc_mark());
+  }
+}
+
+sd_state
+bp_twa::initial_state() {
+  state_t init = src_->get_init_state_number();
+  sd_state res;
+  if (cut_det_)
+  {
+    res.type = State_type::PS1;
+    res.p = sets_.intern(&init, &init + 1);
+  }
+  else
+    res.s = init;
+  return res;
+}
+
+void
+bp_twa::successors(const sd_state& st, std::vector<sd_edge>& out) {
+  switch (st.type)
+  {
+    case State_type::SIMPLE1:
+      // Copy of the input state, and cut transitions from it
+      for (auto& e: src_->out(st.s))
+        if (!(bscc_avoid_
+              && (bscc_avoid_->avoid_state(e.dst)
+                  || bscc_avoid_->avoid_state(e.src))))
+        {
+          sd_state dst;
+          dst.s = e.dst;
+          out.push_back({e.cond, dst, acc_mark()});
+        }
+      for (auto& e: src_->out(st.s))
+        if (cut_condition(e))
+        {
+          auto& succs = cached_cut_successors(e);
+          out.insert(out.end(), succs.begin(), succs.end());
+        }
+      break;
+    case State_type::PS1:
+      if (first_comp_mask_.empty())
+      {
+        state_vect not_avoided;
+        for (state_t s = 0; s < src_->num_states(); ++s)
+          if (!bscc_avoid_ || !bscc_avoid_->avoid_state(s))
+            not_avoided.push_back(s);
+        first_comp_mask_ = psb_->state_mask(not_avoided.begin(),
+                                            not_avoided.end());
+      }
+      compute_edges(*psb_, st.p, first_comp_mask_.data(), scratch_, record_);
+      append_edges(record_, true, true, bddtrue, out);
+      // in cDBA, cut-edges leave each state that contains edge.src
+      for (auto it = sets_.begin(st.p); it != sets_.end(st.p); ++it)
+        for (auto& e: src_->out(*it))
+          if (cut_condition(e))
+          {
+            auto& succs = cached_cut_successors(e);
+            out.insert(out.end(), succs.begin(), succs.end());
+          }
+      break;
+    case State_type::BP2:
+    {
+      breakpoint_state bps(st.level, st.p, st.q);
+      auto intersection = get_and_check_scc(st.p);
+      compute_edges(*psb_, bps, intersection, false, pruning(intersection),
+                    scratch_, record_);
+      append_edges(record_, false, false, bddtrue, out);
+      break;
+    }
+    case State_type::PS2:
+      compute_edges(*psb_, st.p, get_and_check_scc(st.p), scratch_, record_);
+      append_edges(record_, true, false, bddtrue, out);
+      break;
+    case State_type::REUSED2:
+      for (auto& e: src_->out(st.s))
+      {
+        sd_state dst;
+        dst.type = State_type::REUSED2;
+        dst.s = e.dst;
+        out.push_back({e.cond, dst, e.acc});
+      }
+      break;
+  }
+}
+
+std::string
+bp_twa::state_name(const sd_state& st) const {
+  switch (st.type)
+  {
+    case State_type::SIMPLE1:
+    case State_type::REUSED2:
+      return std::to_string(st.s);
+    case State_type::PS1:
+    case State_type::PS2:
+      return powerset_name(sets_, st.p);
+    case State_type::BP2:
+      return bp_name(sets_, breakpoint_state(st.level, st.p, st.q));
   }
+  return "";
 }
 
 // Returns whether a cut transition (jump to the deterministic component)
@@ -436,8 +1020,8 @@ bp_twa::remove_useless_prefixes()
   auto empty_bp = breakpoint_state();
   auto res_ns = res_->num_states();
 
-  // Compute bottommost
-  std::map<state_set, state_t> bottommost_occurence;
+  // Compute bottommost (indexed by the identifier of R)
+  std::vector<state_t> bottommost_occurence(sets_.count());
   auto si_res = spot::scc_info(res_);
   unsigned res_scc_count = si_res.scc_count();
 
@@ -448,7 +1032,7 @@ bp_twa::remove_useless_prefixes()
         {
           auto bps = num2bp_[s];
           if (bps == empty_bp) continue;
-          state_set R = std::get<Bp::P>(bps);
+          set_id R = std::get<Bp::P>(bps);
           bottommost_occurence[R] = s;
         }
     while (n);
@@ -461,7 +1045,7 @@ bp_twa::remove_useless_prefixes()
     auto bps = num2bp_[n];
     retarget[n] = n;
     if (bps == empty_bp) continue;
-    state_set R = std::get<Bp::P>(bps);
+    set_id R = std::get<Bp::P>(bps);
     unsigned other = bottommost_occurence[R];
     retarget[n] =
          (si_res.scc_of(n) != si_res.scc_of(other)) ? other : n;
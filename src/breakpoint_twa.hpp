@@ -17,25 +17,66 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include <types.hpp>
 #include <powerset.hpp>
 #include <cutdet.hpp>
 #include <bscc.hpp>
+#include <simulation.hpp>
 
 /*
 * Gives the name for a breakpoint state of the form: P, Q, level
 * Example:  {q1, q2, q3}, {q1, q3}, 0
 */
-std::string bp_name(breakpoint_state);
+std::string bp_name(const state_set_table&, breakpoint_state);
+
+// A state of the result of bp_twa given by its content rather than by its
+// number in res_aut(): the input state `s` for SIMPLE1 and REUSED2, the
+// set `p` for PS1 and PS2, and (level, p, q) for BP2.
+struct sd_state
+{
+  State_type type = State_type::SIMPLE1;
+  unsigned level = 0;
+  set_id p = state_set_table::empty_id;
+  set_id q = state_set_table::empty_id;
+  state_t s = 0;
+
+  bool operator==(const sd_state& o) const
+  {
+    return type == o.type && level == o.level && p == o.p && q == o.q
+      && s == o.s;
+  }
+};
+
+// An edge leading to an sd_state
+struct sd_edge
+{
+  bdd cond;
+  sd_state dst;
+  acc_mark acc;
+};
 
 class bp_twa {
   public:
-    bp_twa(const_aut_ptr src_aut, bool cut_det, const_om_ptr om)
+    // Builds the result automaton, unless `build` is false: then only the
+    // options and the acceptance condition of res_aut() are set up, and
+    // the automaton can be explored state by state with initial_state()
+    // and successors().
+    //
+    // The construction throws budget_exceeded when it exceeds `budget`,
+    // or the budget given by the options of `om` if `budget` is nullptr.
+    bp_twa(const_aut_ptr src_aut, bool cut_det, const_om_ptr om,
+           bool build = true, const resource_budget* budget = nullptr)
       : cut_det_(cut_det),
         src_(src_aut),
         src_si_(spot::scc_info(src_aut)),
         om_(om),
-        psb_(new powerset_builder(src_)) {
+        own_budget_(budget ? nullptr : new resource_budget(om)),
+        budget_(budget ? budget : own_budget_.get()),
+        psb_(new powerset_builder(src_, sets_, true, budget_)) {
       if (om) {
         scc_aware_ = om->get("scc-aware",1);
         powerset_for_weak_ = om->get("powerset-for-weak",1);
@@ -47,7 +88,18 @@ class bp_twa {
         cut_on_SCC_entry_ = om->get("cut-on-SCC-entry",0);
         bscc_avoid_ = (om->get("bscc-avoid", 1) || reuse_SCC_) ?
           std::make_unique<bscc_avoid>(src_si_) : nullptr;
+        state_estimate_ = om->get("state-estimate", 0);
+        int threads = om->get("threads", 1);
+        scc_decompose_ = om->get("scc-decompose", 0);
+        threads_ = threads > 0 ? threads
+                               : std::max(1u, std::thread::hardware_concurrency());
+        simulation_pruning_ = om->get("simulation-pruning", 0);
       }
+      if (simulation_pruning_)
+        sim_.reset(new direct_simulation(*psb_,
+                                         scc_aware_ ? &src_si_ : nullptr));
+      reserve(state_estimate_ > 0 ? state_estimate_
+                                  : 4 * src_->num_states());
 
       res_ = spot::make_twa_graph(src_->get_dict());
       res_->copy_ap_of(src_);
@@ -61,6 +113,12 @@ class bp_twa {
       } else
         res_->set_buchi();
 
+      if (!build)
+      {
+        res_->set_named_prop("state-names", own_names_.release());
+        return;
+      }
+
       create_first_component();
 
       const auto first_comp_size = res_->num_states();
@@ -79,6 +137,8 @@ class bp_twa {
       // print_res('After cut');
 
       finish_second_component(first_comp_size);
+      // The states are only checked periodically during the construction
+      budget_->check(res_->num_states(), memory_usage());
 
       res_->merge_edges();
 
@@ -88,11 +148,6 @@ class bp_twa {
       // spot::print_hoa(std::cout, src_);
     }
 
-    ~bp_twa()
-    {
-      delete psb_;
-    }
-
     // Getters
     const_aut_ptr src_aut();
     aut_ptr res_aut();
@@ -124,11 +179,11 @@ class bp_twa {
     *
     * In case such powerset_state does not exists, creates one.
     *
-    * @param[in] ps_state (state_set)
+    * @param[in] ps_state (set_id)
     * @param[in] fc       (bool) do we built the 1st component?
     * returns    state (unsigned)
     */
-    state_t ps_state(state_set, bool = false);
+    state_t ps_state(set_id, bool = false);
 
     /**
     * \brief Creates cut transitions after the first component was build.
@@ -148,7 +203,21 @@ class bp_twa {
     * @param[in] from (state_t) State in 1st component
     * @param[in] edge (edge_t)  Edge of the input automaton
     */
-    void add_cut_transition(state_t, edge_t);
+    void add_cut_transition(state_t, const edge_t&);
+
+    /**
+    * \brief Appends the cut transitions built using `edge` to `out`
+    */
+    void cut_successors(const edge_t& edge, std::vector<sd_edge>& out);
+
+    /**
+    * \brief The cut transitions built using `edge`, computed once
+    *
+    * They only depend on `edge` (an edge of src_, not a copy), so in
+    * cDBA they are shared by all states of the 1st component that
+    * contain edge.src.
+    */
+    const std::vector<sd_edge>& cached_cut_successors(const edge_t& edge);
 
     /**
      * \brief Removes states that have equivalent states in other SCCs.
@@ -161,6 +230,36 @@ class bp_twa {
      */
     void remove_useless_prefixes();
 
+    /**
+     * \brief Approximate number of bytes used by the construction
+     *
+     * Counts the tables of the construction and the edges of the result
+     * (but not the names of the states).
+     */
+    size_t memory_usage() const;
+
+    /**
+     * \brief Prepares the state tables for `n` states of the result.
+     *
+     * The tables never grow (and rehash) before holding `n` states. The
+     * estimate can be given by the `state-estimate` option, and defaults
+     * to 4 times the number of states of the input.
+     */
+    void reserve(size_t n);
+
+    /**
+     * \brief On-the-fly interface to the construction.
+     *
+     * successors() appends to `out` the edges leaving `st` in the result,
+     * as built by the constructor (except for the jump-to-bottommost
+     * optimization, which needs the whole automaton). The sets of the
+     * states are interned in the set table of this object, so sd_states
+     * of the same object can be compared with ==.
+     */
+    sd_state initial_state();
+    void successors(const sd_state& st, std::vector<sd_edge>& out);
+    std::string state_name(const sd_state& st) const;
+
     // \brief print the res_ automaton on std::cout and set its name to `name`
     void print_res(std::string * name = nullptr);
 
@@ -182,36 +281,137 @@ class bp_twa {
     //
     void finish_second_component(state_t);
 
-    // For a state_set S from src_ checks that all states in S are from the same
-    // SCC and returns the vector of all states of this SCC.
-    state_vect get_and_check_scc(state_set);
+    // Same as finish_second_component(), but computes the successors of
+    // states on threads_ threads. Builds exactly the same automaton.
+    void finish_second_component_parallel(state_t);
+
+    // With the scc-aware optimization, the states of the 2nd component
+    // whose sets lie in an SCC that is not avoided by bscc_avoid_ never
+    // leave the SCC. For each such SCC reached by a state of res_ from
+    // `start` on (the entry states), this builds the part of the 2nd
+    // component reachable from them independently of the other SCCs (on
+    // threads_ threads), with an SCC-local numbering of states and an
+    // SCC-local powerset builder. The parts are then added to res_ and
+    // their states marked as expanded.
+    void build_scc_pieces(state_t start);
+
+    // Whether the successors of `s` were already built by build_scc_pieces()
+    bool expanded(state_t s) const
+    {
+      return s < expanded_.size() && expanded_[s];
+    }
+
+    // For a set S of states from src_ checks that all states in S are from the
+    // same SCC and returns the bitset of all states of this SCC (or nullptr
+    // if the successors should not be restricted).
+    const bits::word* get_and_check_scc(set_id);
+
+    // The bitset of states of the given SCC of src_ (computed on demand)
+    const bits::word* scc_mask(unsigned scc);
+
+    // Copies the successors of a reused state of src_ (used for SCCs
+    // reused during --reuse-deterministic).
+    //
+    // @param[in] state_t old: the state of src_
+    // @param[in] state_t src: its copy in res_
+    void copy_reused_successors(state_t old, state_t src);
 
     // Create successors (and edges to them) for a given state
     //
     // The possible states right now are:
     //  * breakpoint_state
-    //  * powerset (state_set)
+    //  * powerset (set_id)
     //
     // @param[in] T state     : the given state (may nat exist in any automaton)
     // @param[in] state_t from: state-index (in res_) of state to which we add
     //                          the computed edges (can be also used to add
     //                          behaviour of the given state to state `from`)
-    // @param[in] state_vect intersection:
-    //                        : all successors will be interesected with the
-    //                          states given here (can be states of SCC)
+    // @param[in] intersection: all successors will be interesected with the
+    //                          bitset of states given here (can be states of
+    //                          SCC); no restriction if nullptr
     // @param[in] bool fc     : indicates whether the constructed states should
     //                          belong to the 1st component (for state_set only)
     // @param[in] bdd cond    : build only edges with label described by `cond`
     template <class T>
-    void compute_successors (T, state_t, state_vect * intersection,
+    void compute_successors (T, state_t, const bits::word* intersection,
       bool first_comp = false, bdd cond_constrain = bddtrue);
 
     template <class T>
     void compute_successors (T from, state_t src,
       bool first_comp = false, bdd cond_constrain = bddtrue) {
-        compute_successors<T>(from, src, new state_vect(), first_comp, cond_constrain);
+        compute_successors<T>(from, src, nullptr, first_comp, cond_constrain);
       }
 
+    // Scratch space for the successor computation
+    struct succ_scratch
+    {
+      succ_buffer p;
+      succ_buffer q;
+      // Successors of P under each mark (see succs_by_mark())
+      std::vector<succ_buffer> marked;
+      // Used by direct_simulation::prune()
+      std::vector<bits::word> drop;
+    };
+
+    // Successors of one state computed by compute_edges(), before their
+    // sets are interned and their states created by commit_*_edges().
+    struct succ_record
+    {
+      struct edge
+      {
+        unsigned cond;  // index of the letter class (see powerset_builder)
+        unsigned level; // level of a breakpoint successor
+        bool acc;       // the edge is accepting (breakpoint reached)
+      };
+      std::vector<edge> edges;
+      // The successor of each edge as a bitset (of psb_->state_words()
+      // words); P' followed by Q' for breakpoint states.
+      std::vector<bits::word> words;
+    };
+
+    // The two halves of compute_successors(). compute_edges() only reads
+    // psb (usually *psb_) and its set table, and can run concurrently on
+    // distinct scratch spaces and records.
+    //
+    // The successors of breakpoint states are pruned with `sim` (a
+    // preorder on the states of psb) if it is not nullptr.
+    void compute_edges(const powerset_builder& psb, breakpoint_state,
+                       const bits::word* intersection, bool first_comp,
+                       const direct_simulation* sim,
+                       succ_scratch&, succ_record&) const;
+    void compute_edges(const powerset_builder& psb, set_id,
+                       const bits::word* intersection,
+                       succ_scratch&, succ_record&) const;
+    void commit_bp_edges(state_t src, const succ_record&,
+                         bdd cond_constrain = bddtrue);
+    void commit_ps_edges(state_t src, const succ_record&,
+                         bool first_comp, bdd cond_constrain = bddtrue);
+
+    // Appends the edges of `rec` with a label implied by `cond_constrain`
+    // to `out`, interning their successors.
+    void append_edges(const succ_record& rec, bool powerset, bool first_comp,
+                      bdd cond_constrain, std::vector<sd_edge>& out);
+
+    // Adds a state to res_; checks the budget every 256 states
+    state_t new_state();
+
+    // The state of res_ for `st`, created if needed
+    state_t state_of(const sd_state& st);
+
+    // The preorder used to prune the successors of a breakpoint state
+    // restricted to `intersection` (see get_and_check_scc()), if any. With
+    // the scc-aware optimization, sim_ only holds inside SCCs.
+    const direct_simulation* pruning(const bits::word* intersection) const
+    {
+      return sim_ && (intersection || !scc_aware_) ? sim_.get() : nullptr;
+    }
+
+    // A part of the 2nd component built by build_scc_pieces()
+    struct scc_piece;
+    // `built` counts the states of res_ and of all pieces
+    void explore_scc_piece(scc_piece&, std::atomic<size_t>& built,
+                           succ_scratch&, succ_record&) const;
+
 
     /**
      * Returns whether a cut transition (jump to the deterministic component)
@@ -230,6 +430,10 @@ class bp_twa {
     bool skip_levels_ = false;
     bool cut_always_ = false;
     bool cut_on_SCC_entry_ = false;
+    unsigned state_estimate_ = 0;
+    unsigned threads_ = 1; // threads used by finish_second_component()
+    bool scc_decompose_ = false; // build the 2nd component SCC by SCC
+    bool simulation_pruning_ = false;
 
     // input and result automata
     const_aut_ptr src_;
@@ -242,6 +446,14 @@ class bp_twa {
     // Transformation options
     const_om_ptr om_;
 
+    // Limits of the construction (own_budget_ is used when no budget is
+    // given to the constructor)
+    std::unique_ptr<resource_budget> own_budget_;
+    const resource_budget* budget_;
+
+    // storage of all sets of states of src_ used in res_
+    state_set_table sets_;
+
     // mapping between power_states and their indices
     //(1st comp. of res_ or 2nd comp. of res for weak components)
     power_map  ps2num1_  = power_map();
@@ -258,9 +470,32 @@ class bp_twa {
     state_map old2new2_ = state_map();
     state_map new2old2_ = state_map();
 
-    // names of res automata states
-    state_names names_ = new std::vector<std::string>;
+    // names of res automata states (owned by own_names_ until they are
+    // given to res_, in case the construction throws before)
+    std::unique_ptr<std::vector<std::string>>
+      own_names_ = std::make_unique<std::vector<std::string>>();
+    state_names names_ = own_names_.get();
+
+    // Bitsets of states of each SCC of src_ (see scc_mask())
+    std::vector<std::vector<bits::word>> scc_masks_;
+
+    // States of res_ expanded by build_scc_pieces()
+    std::vector<bool> expanded_;
+
+    // States of src_ not avoided in the 1st component of a cDBA
+    std::vector<bits::word> first_comp_mask_;
+
+    // Scratch space reused by compute_successors()
+    succ_scratch scratch_;
+    succ_record record_;
+    std::vector<sd_edge> edges_;
+
+    // Cut transitions of each edge of src_ (see cached_cut_successors())
+    std::vector<std::unique_ptr<std::vector<sd_edge>>> cut_cache_;
 
     // Builder of powerset successors
-    powerset_builder* psb_;
+    std::unique_ptr<powerset_builder> psb_;
+
+    // Direct simulation on src_, with the simulation-pruning option
+    std::unique_ptr<direct_simulation> sim_;
 };
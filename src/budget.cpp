@@ -0,0 +1,76 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <budget.hpp>
+
+#include <string>
+
+namespace
+{
+  std::string budget_message(budget_exceeded::resource_t resource,
+                             size_t limit)
+  {
+    switch (resource)
+      {
+      case budget_exceeded::states:
+        return "state limit exceeded (max-states="
+          + std::to_string(limit) + ")";
+      case budget_exceeded::memory:
+        return "memory limit exceeded (max-memory="
+          + std::to_string(limit >> 20) + " MiB)";
+      case budget_exceeded::time:
+        return "time limit exceeded (time-limit="
+          + std::to_string(limit / 1000) + " s)";
+      }
+    return "resource limit exceeded";
+  }
+}
+
+budget_exceeded::budget_exceeded(resource_t resource, size_t limit,
+                                 size_t used)
+  : std::runtime_error(budget_message(resource, limit)),
+    resource_(resource), limit_(limit), used_(used)
+{
+}
+
+resource_budget::resource_budget(const spot::option_map* om)
+  : start_(clock::now())
+{
+  if (!om)
+    return;
+  int states = om->get("max-states", 0);
+  int mib = om->get("max-memory", 0);
+  int seconds = om->get("time-limit", 0);
+  if (states > 0)
+    max_states_ = states;
+  if (mib > 0)
+    max_bytes_ = size_t(mib) << 20;
+  if (seconds > 0)
+    {
+      has_deadline_ = true;
+      time_limit_ms_ = size_t(seconds) * 1000;
+      deadline_ = start_ + std::chrono::seconds(seconds);
+    }
+}
+
+size_t
+resource_budget::elapsed_ms() const
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>
+    (clock::now() - start_).count();
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+
+#include <spot/misc/optionmap.hh>
+
+// Thrown when a construction exceeds its resource_budget.
+class budget_exceeded : public std::runtime_error
+{
+public:
+  enum resource_t { states, memory, time };
+
+  // `limit` and `used` are in states, bytes, or milliseconds
+  budget_exceeded(resource_t resource, size_t limit, size_t used);
+
+  resource_t resource() const
+  {
+    return resource_;
+  }
+
+  size_t limit() const
+  {
+    return limit_;
+  }
+
+  size_t used() const
+  {
+    return used_;
+  }
+
+private:
+  resource_t resource_;
+  size_t limit_;
+  size_t used_;
+};
+
+// Limits on the resources used by the constructions, given by the options
+//   max-states   maximal number of states of a constructed automaton
+//   max-memory   maximal memory used by a construction (in MiB)
+//   time-limit   wall-clock time (in seconds) since the budget was created
+// where 0 (the default) means no limit.
+//
+// The constructions check the budget cooperatively in their main loops
+// and throw budget_exceeded when a limit is reached. The memory is the
+// estimate given by the data structures of the construction, not the
+// memory of the process.
+class resource_budget
+{
+public:
+  explicit resource_budget(const spot::option_map* om = nullptr);
+
+  // A copy of this budget (with the same deadline) that also limits the
+  // number of states to `states`
+  resource_budget with_max_states(size_t states) const
+  {
+    resource_budget res = *this;
+    if (!res.max_states_ || states < res.max_states_)
+      res.max_states_ = states;
+    return res;
+  }
+
+  // Whether some limit is set
+  bool limited() const
+  {
+    return max_states_ || max_bytes_ || has_deadline_;
+  }
+
+  void check_states(size_t states) const
+  {
+    if (max_states_ && states > max_states_)
+      throw budget_exceeded(budget_exceeded::states, max_states_, states);
+  }
+
+  void check_memory(size_t bytes) const
+  {
+    if (max_bytes_ && bytes > max_bytes_)
+      throw budget_exceeded(budget_exceeded::memory, max_bytes_, bytes);
+  }
+
+  void check_time() const
+  {
+    if (has_deadline_ && clock::now() > deadline_)
+      throw budget_exceeded(budget_exceeded::time, time_limit_ms_,
+                            elapsed_ms());
+  }
+
+  // All of the above
+  void check(size_t states, size_t bytes) const
+  {
+    check_states(states);
+    check_memory(bytes);
+    check_time();
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  size_t elapsed_ms() const;
+
+  size_t max_states_ = 0;
+  size_t max_bytes_ = 0;
+  bool has_deadline_ = false;
+  size_t time_limit_ms_ = 0;
+  clock::time_point start_;
+  clock::time_point deadline_;
+};
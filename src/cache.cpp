@@ -0,0 +1,241 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "config.h"
+#include <cache.hpp>
+#include <statemap.hpp>
+#include <subprocess.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spot/misc/version.hh>
+#include <spot/twaalgos/canonicalize.hh>
+#include <spot/twaalgos/hoa.hh>
+
+namespace
+{
+  const char magic[] = "seminator-cache\n";
+  const char suffix[] = ".hoa";
+
+  bool is_entry(const std::string& name)
+  {
+    size_t n = sizeof(suffix) - 1;
+    return name.size() > n && name.compare(name.size() - n, n, suffix) == 0;
+  }
+
+  struct file_info
+  {
+    timespec mtime;
+    size_t size;
+    std::string path;
+  };
+
+  // The entries of the cache in `dir`
+  std::vector<file_info> scan(const std::string& dir)
+  {
+    std::vector<file_info> files;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+      return files;
+    while (dirent* e = readdir(d))
+      {
+        std::string name = e->d_name;
+        if (!is_entry(name))
+          continue;
+        std::string path = dir + '/' + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+          files.push_back({st.st_mtim, size_t(st.st_size), path});
+      }
+    closedir(d);
+    return files;
+  }
+}
+
+result_cache::result_cache(const std::string& dir, size_t max_bytes,
+                           size_t memory_entries)
+  : dir_(dir), max_bytes_(max_bytes), memory_entries_(memory_entries)
+{
+  if (mkdir(dir_.c_str(), 0777) < 0 && errno != EEXIST)
+    throw std::runtime_error("cannot create cache directory " + dir_);
+  struct stat st;
+  if (stat(dir_.c_str(), &st) < 0 || !S_ISDIR(st.st_mode))
+    throw std::runtime_error(dir_ + " is not a directory");
+  for (auto& f: scan(dir_))
+    disk_bytes_ += f.size;
+}
+
+std::string
+result_cache::key(const spot::const_twa_graph_ptr& aut,
+                  const std::string& context)
+{
+  // The copy has no name, and its states are numbered canonically.
+  auto copy = spot::make_twa_graph(aut, spot::twa::prop_set::all());
+  copy = spot::canonicalize(copy);
+  std::ostringstream os;
+  os << "Seminator " PACKAGE_VERSION " (using Spot " << spot::version()
+     << ")\n" << context << '\n';
+  spot::print_hoa(os, copy);
+  return os.str();
+}
+
+std::string
+result_cache::path_of(const std::string& key) const
+{
+  // FNV-1a, with the final avalanche step of mix_hash()
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c: key)
+    {
+      h ^= c;
+      h *= 1099511628211ULL;
+    }
+  char name[17];
+  snprintf(name, sizeof name, "%016llx",
+           static_cast<unsigned long long>(mix_hash(h)));
+  return dir_ + '/' + name + suffix;
+}
+
+void
+result_cache::remember(const std::string& name, const std::string& key,
+                       const std::string& hoa)
+{
+  if (memory_entries_ == 0)
+    return;
+  auto it = memory_.find(name);
+  if (it != memory_.end())
+    lru_.erase(it->second);
+  lru_.emplace_front(name, memory_entry{key, hoa});
+  memory_[name] = lru_.begin();
+  if (lru_.size() > memory_entries_)
+    {
+      memory_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+}
+
+spot::twa_graph_ptr
+result_cache::lookup(const std::string& key, const spot::bdd_dict_ptr& dict)
+{
+  std::string path = path_of(key);
+  try
+    {
+      auto it = memory_.find(path);
+      if (it != memory_.end() && it->second->second.key == key)
+        {
+          lru_.splice(lru_.begin(), lru_, it->second);
+          return automaton_from_string(lru_.front().second.hoa, dict);
+        }
+
+      std::ifstream in(path, std::ios::binary);
+      if (!in)
+        return nullptr;
+      std::ostringstream data;
+      data << in.rdbuf();
+      std::string s = data.str();
+      size_t m = sizeof(magic) - 1;
+      if (s.compare(0, m, magic) != 0)
+        return nullptr;
+      size_t eol = s.find('\n', m);
+      if (eol == std::string::npos)
+        return nullptr;
+      size_t len = std::stoul(s.substr(m, eol - m));
+      if (s.size() < eol + 1 + len || s.compare(eol + 1, len, key) != 0)
+        return nullptr;
+      std::string hoa = s.substr(eol + 1 + len);
+      auto aut = automaton_from_string(hoa, dict);
+      // Mark the entry as recently used
+      utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+      remember(path, key, hoa);
+      return aut;
+    }
+  catch (const std::exception&)
+    {
+      // A damaged entry
+      return nullptr;
+    }
+}
+
+void
+result_cache::store(const std::string& key,
+                    const spot::const_twa_graph_ptr& aut)
+{
+  std::string path = path_of(key);
+  std::string hoa = automaton_to_string(aut);
+  remember(path, key, hoa);
+
+  // Written under a temporary name, so that concurrent readers never see
+  // a partial entry
+  std::string tmp = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    out << magic << key.size() << '\n' << key << hoa;
+    if (!out.flush())
+      {
+        out.close();
+        std::remove(tmp.c_str());
+        return;
+      }
+  }
+  struct stat st;
+  size_t old_size = stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+      std::remove(tmp.c_str());
+      return;
+    }
+  if (stat(path.c_str(), &st) == 0)
+    disk_bytes_ += st.st_size;
+  disk_bytes_ -= std::min(disk_bytes_, old_size);
+  if (max_bytes_ && disk_bytes_ > max_bytes_)
+    evict();
+}
+
+void
+result_cache::evict()
+{
+  auto files = scan(dir_);
+  std::sort(files.begin(), files.end(),
+            [](const file_info& a, const file_info& b)
+            {
+              return std::tie(a.mtime.tv_sec, a.mtime.tv_nsec)
+                < std::tie(b.mtime.tv_sec, b.mtime.tv_nsec);
+            });
+  disk_bytes_ = 0;
+  for (auto& f: files)
+    disk_bytes_ += f.size;
+  for (auto& f: files)
+    {
+      if (disk_bytes_ <= max_bytes_)
+        break;
+      if (std::remove(f.path.c_str()) == 0)
+        disk_bytes_ -= f.size;
+    }
+}
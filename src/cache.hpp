@@ -0,0 +1,95 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <spot/twa/twagraph.hh>
+
+// Cache of computed automata, stored in a directory so that it persists
+// across runs (and can be shared by concurrent processes).
+//
+// An entry maps a key to an automaton in the HOA format. The key of a
+// computation is made of the canonical form of its input automaton, of a
+// description of the computation (the options that influence it), and of
+// the versions of Seminator and Spot (see key()). The file of an entry is
+// named after a hash of the key, but also contains the key, so that a
+// collision of hashes is a miss rather than a wrong result.
+//
+// The directory is bounded to `max_bytes` (0 for no bound): when a store
+// makes it larger, the least recently used entries are removed. The most
+// recently used entries are also kept in memory, so that duplicates
+// within one run do not read the directory again.
+//
+// Errors of the file system are ignored: the entry is then not stored,
+// or not found.
+class result_cache
+{
+public:
+  // Creates `dir` if needed; throws std::runtime_error if it is not a
+  // usable directory.
+  explicit result_cache(const std::string& dir, size_t max_bytes = 0,
+                        size_t memory_entries = 256);
+
+  result_cache(const result_cache&) = delete;
+  result_cache& operator=(const result_cache&) = delete;
+
+  // The key of the computation described by `context` on `aut`
+  static std::string key(const spot::const_twa_graph_ptr& aut,
+                         const std::string& context);
+
+  // The automaton stored for `key` (using `dict`), or nullptr
+  spot::twa_graph_ptr lookup(const std::string& key,
+                             const spot::bdd_dict_ptr& dict);
+
+  void store(const std::string& key, const spot::const_twa_graph_ptr& aut);
+
+  // Total size of the entries in the directory, in bytes
+  size_t disk_usage() const
+  {
+    return disk_bytes_;
+  }
+
+private:
+  struct memory_entry
+  {
+    std::string key;
+    std::string hoa;
+  };
+
+  std::string path_of(const std::string& key) const;
+  void remember(const std::string& name, const std::string& key,
+                const std::string& hoa);
+  void evict();
+
+  std::string dir_;
+  size_t max_bytes_;
+  size_t disk_bytes_ = 0;
+
+  // In-memory layer: most recently used entries first, indexed by the
+  // name of their file
+  size_t memory_entries_;
+  std::list<std::pair<std::string, memory_entry>> lru_;
+  std::unordered_map<std::string,
+                     decltype(lru_)::iterator> memory_;
+};
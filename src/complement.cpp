@@ -15,14 +15,19 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <deque>
+#include <algorithm>
 #include <map>
+#include <thread>
+#include <tuple>
 
-#include <spot/misc/hashfunc.hh>
 #include <spot/twaalgos/isdet.hh>
 #include <spot/twaalgos/sccinfo.hh>
 
 #include <types.hpp>
+#include <bitops.hpp>
+#include <parallel.hpp>
+#include <powerset.hpp>
+#include <statemap.hpp>
 
 // This contains a modified version of Spot 2.8's complement_semidet()
 // function (spot/twaalgos/complement.cc).  It will likely be
@@ -31,35 +36,56 @@ namespace from_spot
 {
     namespace
     {
-        enum ncsb
+        // A macrostate is stored as four bitsets over the states of the
+        // input, of `nw` words each: N, C, S, and B, in this order. The
+        // states of B are also in C.
+        typedef std::vector<bits::word> mstate;
+
+        // Scratch space of the computation of the successors of a
+        // macrostate (one per thread): the letter classes of the edges
+        // of its states, the signature of a class (the edges it selects
+        // from each state) with the group of each signature, the
+        // (group, class) pairs of the classes that need a successor,
+        // the successors under one group (each one 4 * nw words) with
+        // whether their edge is accepting, and the image of B.
+        struct ncsb_scratch
         {
-            ncsb_n = 0,       // non deterministic
-            ncsb_c = 2 ,       // needs check
-            ncsb_cb = 3,      // needs check AND in breakpoint
-            ncsb_s = 4,       // safe
-            ncsb_m = 1,       // missing
+            std::vector<unsigned> classes;
+            std::vector<unsigned> signature;
+            std::map<std::vector<unsigned>, unsigned> group_of;
+            std::vector<std::pair<unsigned, unsigned>> grouped;
+            std::vector<bits::word> succs;
+            std::vector<bool> acc_succs;
+            std::vector<bits::word> post_b;
         };
 
-        typedef std::vector<ncsb> mstate;
-        typedef std::vector<std::pair<unsigned, ncsb>> small_mstate;
-
-        struct small_mstate_hash
+        // The successors of a macrostate, computed without touching any
+        // BDD, so that several macrostates can be processed
+        // concurrently. All letters of a group lead to the same
+        // successors; the letter classes of the group `g` are
+        // group_classes[group_end[g-1]] ... group_classes[group_end[g]-1].
+        // The successor `j` is stored in succs[j * 4 * nw] ...
+        // succs[(j + 1) * 4 * nw - 1], and reached by an edge labeled
+        // by the group group_of_succ[j], accepting iff acc_succs[j].
+        struct ncsb_record
         {
-            size_t
-            operator()(small_mstate s) const noexcept
-            {
-              size_t hash = 0;
-              for (const auto& p: s)
-              {
-                hash = spot::wang32_hash(hash ^ ((p.first<<2) | p.second));
-              }
-              return hash;
-            }
+            // The states of N, C, and S
+            std::vector<unsigned> members;
+            // Whether the letters without edge from any member lead to
+            // the empty macrostate (when B has no non-accepting state)
+            bool sink;
+            std::vector<unsigned> group_classes;
+            std::vector<unsigned> group_end;
+            std::vector<bits::word> succs;
+            std::vector<bool> acc_succs;
+            std::vector<unsigned> group_of_succ;
         };
 
         class ncsb_complementation
         {
         private:
+            typedef powerset_builder::succ_entry succ_entry;
+
             // The source automaton.
             const spot::const_twa_graph_ptr aut_;
 
@@ -69,27 +95,53 @@ namespace from_spot
             // Number of states in the input automaton.
             unsigned nb_states_;
 
+            // Number of words of a bitset over the states of the input
+            size_t nw_;
+
+            // Number of threads used by run()
+            unsigned threads_;
+
             // The complement being built.
             spot::twa_graph_ptr res_;
 
             // Association between NCSB states and state numbers of the
-            // complement.
-            std::unordered_map<small_mstate, unsigned, small_mstate_hash> ncsb2n_;
-
-            // States to process.
-            std::deque<std::pair<mstate, unsigned>> todo_;
-
-            // Support for each state of the source automaton.
-            std::vector<bdd> support_;
+            // complement. The macrostate of the state `s` is stored in
+            // mstates_[s * 4 * nw_] ... mstates_[(s + 1) * 4 * nw_ - 1],
+            // together with its hash in hashes_[s]. The macrostates are
+            // indexed by an open-addressing table with linear probing
+            // (-1U marks a free bucket), whose load factor is kept under
+            // 1/2. The states are processed in the order of their
+            // numbers, so the states still to process are always the
+            // last ones.
+            std::vector<bits::word> mstates_;
+            std::vector<uint64_t> hashes_;
+            std::vector<unsigned> buckets_;
 
             // Propositions compatible with all transitions of a state.
             std::vector<bdd> compat_;
 
-            // Whether a SCC is deterministic or not
-            std::vector<bool> is_deter_;
+            // States in the deterministic SCCs
+            std::vector<bits::word> is_deter_;
+
+            // States that only have accepting transitions
+            std::vector<bits::word> is_accepting_;
 
-            // Whether a state only has accepting transitions
-            std::vector<bool> is_accepting_;
+            // Successors of the states of the input for each letter class
+            // (the powerset construction is not used otherwise)
+            state_set_table sets_;
+            powerset_builder psb_;
+
+            // Edges of the current macrostate, merged by commit() before
+            // they are added to res_, and the labels of its groups of
+            // letters
+            struct out_edge
+            {
+              unsigned dst;
+              bool acc;
+              bdd cond;
+            };
+            std::vector<out_edge> out_;
+            std::vector<bdd> group_conds_;
 
             // State names for graphviz display
             std::vector<std::string>* names_;
@@ -97,354 +149,488 @@ namespace from_spot
             // Show NCSB states in state name to help debug
             bool show_names_;
 
-            std::string
-            get_name(const small_mstate& ms)
+            // The successors of `i` under the letter class `c`
+            std::pair<const succ_entry*, const succ_entry*>
+            succs_of(unsigned i, unsigned c) const
             {
-              std::string res = "{";
-
-              bool first_state = true;
-              for (const auto& p: ms)
-                if (p.second == ncsb_n)
-                {
-                  if (!first_state)
-                    res += ",";
-                  first_state = false;
-                  res += std::to_string(p.first);
-                }
-
-              res += "},{";
-
-              first_state = true;
-              for (const auto& p: ms)
-                if (p.second & ncsb_c)
-                {
-                  if (!first_state)
-                    res += ",";
-                  first_state = false;
-                  res += std::to_string(p.first);
-                }
-
-              res += "},{";
+              auto b = std::lower_bound(psb_.succ_begin(i), psb_.succ_end(i),
+                                        c, [](const succ_entry& e, unsigned c)
+                                        {
+                                          return e.cond < c;
+                                        });
+              auto e = b;
+              while (e != psb_.succ_end(i) && e->cond == c)
+                ++e;
+              return {b, e};
+            }
 
-              first_state = true;
-              for (const auto& p: ms)
-                if (p.second == ncsb_s)
+            // The states of the bitset `set`, as "s1,s2,..."
+            std::string
+            list_states(const bits::word* set) const
+            {
+              std::string res;
+              for (size_t w = 0; w < nw_; ++w)
+                for (bits::word x = set[w]; x; x &= x - 1)
                 {
-                  if (!first_state)
+                  if (!res.empty())
                     res += ",";
-                  first_state = false;
-                  res += std::to_string(p.first);
+                  res += std::to_string(w * 64 + __builtin_ctzll(x));
                 }
+              return res;
+            }
 
-              res += "},{";
-
-              first_state = true;
-              for (const auto& p: ms)
-                if (p.second == ncsb_cb)
-                {
-                  if (!first_state)
-                    res += ",";
-                  first_state = false;
-                  res += std::to_string(p.first);
-                }
+            std::string
+            get_name(const bits::word* ms) const
+            {
+              return "{" + list_states(ms) + "},{" + list_states(ms + nw_)
+                + "},{" + list_states(ms + 2 * nw_) + "},{"
+                + list_states(ms + 3 * nw_) + "}";
+            }
 
-              return res + "}";
+            static uint64_t
+            hash_mstate(const bits::word* ms, size_t size)
+            {
+              uint64_t h = 0;
+              for (size_t i = 0; i < size; ++i)
+                h = mix_hash(h ^ ms[i]) + i;
+              return h;
             }
 
-            small_mstate
-            to_small_mstate(const mstate& ms)
+            void
+            grow()
             {
-              unsigned count = 0;
-              for (unsigned i = 0; i < nb_states_; ++i)
-                count+= (ms[i] != ncsb_m);
-              small_mstate small;
-              small.reserve(count);
-              for (unsigned i = 0; i < nb_states_; ++i)
-                if (ms[i] != ncsb_m)
-                  small.emplace_back(i, ms[i]);
-              return small;
+              std::vector<unsigned> nb(buckets_.size() * 2, -1U);
+              size_t mask = nb.size() - 1;
+              for (unsigned id = 0; id < hashes_.size(); ++id)
+              {
+                size_t pos = hashes_[id] & mask;
+                while (nb[pos] != -1U)
+                  pos = (pos + 1) & mask;
+                nb[pos] = id;
+              }
+              buckets_.swap(nb);
             }
 
             // From a NCSB state, looks for a duplicate in the map before
             // creating a new state if needed.
             unsigned
-            new_state(mstate&& s)
+            new_state(const bits::word* s)
             {
-              auto p = ncsb2n_.emplace(to_small_mstate(s), 0);
-              if (p.second) // This is a new state
+              size_t size = 4 * nw_;
+              uint64_t h = hash_mstate(s, size);
+              size_t mask = buckets_.size() - 1;
+              size_t pos = h & mask;
+              for (;;)
               {
-                p.first->second = res_->new_state();
-                if (show_names_)
-                  names_->push_back(get_name(p.first->first));
-                todo_.emplace_back(std::move(s), p.first->second);
+                unsigned id = buckets_[pos];
+                if (id == -1U)
+                  break;
+                if (hashes_[id] == h
+                    && bits::equal(mstates_.data() + id * size, s, size))
+                  return id;
+                pos = (pos + 1) & mask;
               }
-              return p.first->second;
+
+              // This is a new state
+              unsigned id = res_->new_state();
+              assert(id == hashes_.size());
+              buckets_[pos] = id;
+              hashes_.push_back(h);
+              mstates_.insert(mstates_.end(), s, s + size);
+              if (show_names_)
+                names_->push_back(get_name(s));
+              if (2 * hashes_.size() > buckets_.size())
+                grow();
+              return id;
             }
 
+            // Appends to sc.succs a copy of the successor `j`, with the
+            // state `i` moved from C (and B) to S
             void
-            ncsb_successors(mstate&& ms, unsigned origin, bdd letter)
+            push_moved_to_s(ncsb_scratch& sc, size_t j, unsigned i,
+                            bool acc) const
             {
-              std::vector <mstate> succs;
-              succs.emplace_back(nb_states_, ncsb_m);
+              size_t size = 4 * nw_;
+              sc.succs.resize(sc.succs.size() + size);
+              bits::word* dst = sc.succs.data() + sc.succs.size() - size;
+              bits::copy(dst, sc.succs.data() + j * size, size);
+              bits::clear(dst + nw_, i);
+              bits::clear(dst + 3 * nw_, i);
+              bits::set(dst + 2 * nw_, i);
+              sc.acc_succs.push_back(acc);
+            }
 
-              // PLDI: accepting transitions when B' would be empty
-              std::vector <bool> acc_succs;
-              acc_succs.push_back(false);
+            // Appends to `rec` the successors of `ms` under the letters
+            // of the group `g`, which lead to the same edges as the class
+            // `c` from the states of `ms`.
+            //
+            // The successors of each set are computed as a union of the
+            // successors of its states under `c` (read from the index of
+            // psb_), and the NCSB rules are then applied to whole
+            // bitsets.
+            void
+            ncsb_successors(const bits::word* ms, unsigned c, unsigned g,
+                            ncsb_scratch& sc, ncsb_record& rec) const
+            {
+              size_t nw = nw_;
+              size_t size = 4 * nw;
+              sc.succs.assign(size, 0);
+              sc.acc_succs.assign(1, false);
+              sc.post_b.assign(nw, 0);
+              bits::word* n1 = sc.succs.data();
+              bits::word* c1 = n1 + nw;
+              bits::word* s1 = n1 + 2 * nw;
+              bits::word* b1 = n1 + 3 * nw;
+              const bits::word* acc = is_accepting_.data();
 
               // Handle S states.
               //
               // Treated first because we can escape early if the letter
               // leads to an accepting transition for a Safe state.
-              for (unsigned i = 0; i < nb_states_; ++i)
-              {
-                if (ms[i] != ncsb_s)
-                  continue;
-
-                for (const auto &t: aut_->out(i))
+              for (size_t w = 0; w < nw; ++w)
+                for (bits::word x = ms[2 * nw + w]; x; x &= x - 1)
                 {
-                  if (!bdd_implies(letter, t.cond))
-                    continue;
-                  if (t.acc || is_accepting_[t.dst])
-                    // Exit early; transition is forbidden for safe
-                    // state.
-                    return;
-
-                  succs[0][t.dst] = ncsb_s;
-
-                  // No need to look for other compatible transitions
-                  // for this state; it's in the deterministic part of
-                  // the automaton
-                  break;
+                  auto r = succs_of(w * 64 + __builtin_ctzll(x), c);
+                  for (auto e = r.first; e != r.second; ++e)
+                  {
+                    if (e->acc || bits::test(acc, e->dst))
+                      // Exit early; transition is forbidden for safe
+                      // state.
+                      return;
+                    bits::set(s1, e->dst);
+                  }
                 }
-              }
 
-              // Handle C states.
-              for (unsigned i = 0; i < nb_states_; ++i)
+              // Handle C and N states.
+              for (size_t w = 0; w < nw; ++w)
               {
-                if (!(ms[i] & ncsb_c))
-                  continue;
-
-                for (const auto &t: aut_->out(i))
+                for (bits::word x = ms[nw + w]; x; x &= x - 1)
                 {
-                  if (!bdd_implies(letter, t.cond))
-                    continue;
-
-                  // PLDI optimization:
-                  // Compute C' and remove states that are already in S'
-                  // We have still only unique successor
-                  if (succs[0][t.dst] == ncsb_m)
-                    succs[0][t.dst] = ncsb_c;
-
-                  // No need to look for other compatible transitions
-                  // for this state; it's in the deterministic part of
-                  // the automaton
-                  break;
+                  auto r = succs_of(w * 64 + __builtin_ctzll(x), c);
+                  for (auto e = r.first; e != r.second; ++e)
+                    bits::set(c1, e->dst);
                 }
-              }
-
-              // Handle N states.
-              for (unsigned i = 0; i < nb_states_; ++i)
-              {
-                if (ms[i] != ncsb_n)
-                  continue;
-                for (const auto &t: aut_->out(i))
+                for (bits::word x = ms[w]; x; x &= x - 1)
                 {
-                  if (!bdd_implies(letter, t.cond))
-                    continue;
-
-                  // PLDI: All states from 2nd component go to C only.
-                  // PLDI: We have still only a unique successor
-                  if (is_deter_[si_.scc_of(t.dst)])
-                  {
-                    if (succs[0][t.dst] == ncsb_m)
-                      succs[0][t.dst] = ncsb_c;
-                  } else
-                    for (auto &succ: succs)
-                      succ[t.dst] = ncsb_n;
+                  auto r = succs_of(w * 64 + __builtin_ctzll(x), c);
+                  for (auto e = r.first; e != r.second; ++e)
+                    bits::set(n1, e->dst);
                 }
               }
-
-              // PLDI: Handle B states. We need to know what remained in C'.
-              // PLDI: We first move all successors to B', and then pereform
-              // branching in next pass
-              for (unsigned i = 0; i < nb_states_; ++i)
+              // PLDI: Compute C' and remove states that are already in S'.
+              // PLDI: All states from 2nd component go to C only.
+              for (size_t w = 0; w < nw; ++w)
               {
-                if (ms[i] != ncsb_cb)
-                  continue;
+                c1[w] = (c1[w] | (n1[w] & is_deter_[w])) & ~s1[w];
+                n1[w] &= ~is_deter_[w];
+              }
 
-                bool has_succ = false;
-                for (const auto &t: aut_->out(i))
+              // PLDI: Handle B states. We need to know what remained in C'.
+              for (size_t w = 0; w < nw; ++w)
+                for (bits::word x = ms[3 * nw + w]; x; x &= x - 1)
                 {
-                  if (!bdd_implies(letter, t.cond))
-                    continue;
-
-                  has_succ = true;
-                  if (succs[0][t.dst] == ncsb_c)
-                      succs[0][t.dst] = ncsb_cb;
-
-                  // PLDI: If t is not accepting and t.dst in S, stop
-                  // because t.src should have been i S already.
-                  if (!t.acc && (succs[0][t.dst] == ncsb_s))
+                  unsigned i = w * 64 + __builtin_ctzll(x);
+                  auto r = succs_of(i, c);
+                  if (r.first == r.second && !bits::test(acc, i))
                     return;
-
-                  // No need to look for other compatible transitions
-                  // for this state; it's in the deterministic part of
-                  // the automaton
-                  break;
+                  for (auto e = r.first; e != r.second; ++e)
+                  {
+                    // PLDI: If t is not accepting and t.dst in S, stop
+                    // because t.src should have been i S already.
+                    if (!e->acc && bits::test(s1, e->dst))
+                      return;
+                    bits::set(sc.post_b.data(), e->dst);
+                  }
                 }
-                if (!has_succ && !is_accepting_[i])
-                  return;
-              }
+              for (size_t w = 0; w < nw; ++w)
+                b1[w] = sc.post_b[w] & c1[w];
 
               // Allow to move accepting dst to S'
-              for (unsigned i = 0; i < nb_states_; ++i)
-              {
-                if (ms[i] != ncsb_cb)
-                  continue;
-
-                for (const auto &t: aut_->out(i))
+              for (size_t w = 0; w < nw; ++w)
+                for (bits::word x = ms[3 * nw + w]; x; x &= x - 1)
                 {
-                  if (!bdd_implies(letter, t.cond))
-                    continue;
-
-                  if (t.acc)
+                  auto r = succs_of(w * 64 + __builtin_ctzll(x), c);
+                  for (auto e = r.first; e != r.second; ++e)
                   {
+                    if (!e->acc || bits::test(acc, e->dst))
+                      continue;
                     // double all the current possible states
-                    unsigned length = succs.size();
-                    for (unsigned j = 0; j < length; ++j)
-                    {
-                      if ((succs[j][t.dst] == ncsb_cb) & (!is_accepting_[t.dst]))
-                      {
-                        succs.push_back(succs[j]);
-                        succs.back()[t.dst] = ncsb_s;
-                        acc_succs.push_back(false);
-                      }
-                    }
+                    size_t length = sc.acc_succs.size();
+                    for (size_t j = 0; j < length; ++j)
+                      if (bits::test(sc.succs.data() + j * size + 3 * nw,
+                                     e->dst))
+                        push_moved_to_s(sc, j, e->dst, false);
                   }
                 }
-              }
 
               // PLDI: For each possible successor check if B' might be empty
-              // If yes, double the successors for each state in C', make edges
-              // to all clones accepting.
+              // If yes, move C' to B' and make the edge accepting, and add
+              // the clones where any subset of the non-accepting states of
+              // C' is moved to S' (with accepting edges as well).
+              size_t length = sc.acc_succs.size();
+              for (size_t j = 0; j < length; ++j)
               {
-                unsigned length = succs.size();
-                for (unsigned j = 0; j < length; ++j)
-                {
-                  // Check for empty B'
-                  bool b_empty = true;
-                  for (unsigned i = 0; i < nb_states_; ++i)
+                bits::word* sj = sc.succs.data() + j * size;
+                if (bits::any(sj + 3 * nw, nw))
+                  continue;
+                bits::copy(sj + 3 * nw, sj + nw, nw);
+                sc.acc_succs[j] = true;
+                // The clones of succ j are appended to sc.succs in the
+                // order in which they are created.
+                size_t first_clone = sc.acc_succs.size();
+                for (size_t w = 0; w < nw; ++w)
+                  for (bits::word x = sj[3 * nw + w] & ~acc[w]; x; x &= x - 1)
                   {
-                    if (succs[j][i] == ncsb_cb) {
-                      b_empty = false;
-                      break;
-                    }
+                    unsigned i = w * 64 + __builtin_ctzll(x);
+                    size_t k_length = sc.acc_succs.size();
+                    push_moved_to_s(sc, j, i, true);
+                    for (size_t k = first_clone; k < k_length; ++k)
+                      push_moved_to_s(sc, k, i, true);
+                    // push_moved_to_s() may reallocate sc.succs
+                    sj = sc.succs.data() + j * size;
                   }
+              }
+
+              rec.succs.insert(rec.succs.end(),
+                               sc.succs.begin(), sc.succs.end());
+              rec.acc_succs.insert(rec.acc_succs.end(),
+                                   sc.acc_succs.begin(), sc.acc_succs.end());
+              rec.group_of_succ.insert(rec.group_of_succ.end(),
+                                       sc.acc_succs.size(), g);
+            }
 
-                  if (b_empty)
+            // Computes the successors of `ms` into `rec`. Only reads the
+            // bitsets and the index of psb_, so that it can run
+            // concurrently for several macrostates.
+            //
+            // The letters that need a successor are those compatible
+            // with all non-accepting states of B if there is one, and
+            // those compatible with any state of N, C, or S otherwise.
+            // As the letter classes partition the labels of the edges,
+            // these are the classes on which all (or any) of these
+            // states have an edge. The classes are grouped by the edges
+            // they select from each state: all letters of a group have
+            // the same successors from the macrostate. The groups are
+            // listed in the order of their first class.
+            void
+            compute_successors(const bits::word* ms, ncsb_scratch& sc,
+                               ncsb_record& rec) const
+            {
+              size_t nw = nw_;
+              rec.members.clear();
+              rec.sink = true;
+              rec.group_classes.clear();
+              rec.group_end.clear();
+              rec.succs.clear();
+              rec.acc_succs.clear();
+              rec.group_of_succ.clear();
+
+              sc.classes.clear();
+              for (size_t w = 0; w < nw; ++w)
+                for (bits::word x = ms[w] | ms[nw + w] | ms[2 * nw + w];
+                     x; x &= x - 1)
+                {
+                  unsigned i = w * 64 + __builtin_ctzll(x);
+                  rec.members.push_back(i);
+                  // PLDI: the accepting states of B and the other
+                  // states of C could be also virtually in S
+                  if (bits::test(ms + 3 * nw, i)
+                      && !bits::test(is_accepting_.data(), i))
+                    rec.sink = false;
+                  for (auto e = psb_.succ_begin(i);
+                       e != psb_.succ_end(i); ++e)
+                    sc.classes.push_back(e->cond);
+                }
+              std::sort(sc.classes.begin(), sc.classes.end());
+              sc.classes.erase(std::unique(sc.classes.begin(),
+                                           sc.classes.end()),
+                               sc.classes.end());
+
+              sc.group_of.clear();
+              sc.grouped.clear();
+              for (unsigned c: sc.classes)
+              {
+                bool needed = true;
+                for (size_t w = 0; w < nw && needed && !rec.sink; ++w)
+                  for (bits::word x = ms[3 * nw + w] & ~is_accepting_[w];
+                       x && needed; x &= x - 1)
                   {
-                    //PLDI: for each state s in C', move it to B'
-                    // if s is not accepting make a clone
-                    // of all succs in new_succs where s is in S'
-                    for (unsigned i = 0; i < nb_states_; ++i) {
-                      if (succs[j][i] != ncsb_c) {
-                        continue;
-                      }
-                      succs[j][i] = ncsb_cb;
-                    }
-
-                    // Set edge as accepting
-                    acc_succs[j] = true;
-                    std::vector <mstate> new_succs; // Store clones of current succ
-                    new_succs.push_back(succs[j]);
-
-                    //PLDI: for each state s in C'
-                    // if s is not accepting make a clone
-                    // of all succs in new_succs where s is in S'
-                    for (unsigned i = 0; i < nb_states_; ++i) {
-                      if (succs[j][i] != ncsb_cb) {
-                        continue;
-                      }
-
-                      {
-                        unsigned k_length = new_succs.size();
-                        for (unsigned k = 0; k < k_length; ++k) {
-                          //PLDI: skip accepting states
-                          if (is_accepting_[i])
-                            continue;
-
-                          // Make copy of k with i moved from C to S
-                          new_succs.push_back(new_succs[k]);
-                          new_succs.back()[i] = ncsb_s;
-                        }
-                      }
-                      // new_succs[0] is succ[j] with C -> CB
-                      succs[j] = new_succs[0];
-                      // Move the rest to the end of succ
-                      unsigned k_length = new_succs.size();
-                      for (unsigned k = 1; k < k_length; ++k) {
-                        succs.push_back(new_succs[k]);
-                        acc_succs.push_back(true);
-                      }
-                    }
+                    auto r = succs_of(w * 64 + __builtin_ctzll(x), c);
+                    needed = r.first != r.second;
                   }
+                if (!needed)
+                  continue;
+                sc.signature.clear();
+                for (unsigned i: rec.members)
+                {
+                  auto r = succs_of(i, c);
+                  sc.signature.push_back(r.second - r.first);
+                  for (auto e = r.first; e != r.second; ++e)
+                    sc.signature.push_back(2 * e->dst + bool(e->acc));
                 }
+                unsigned g = sc.group_of.emplace(sc.signature,
+                                                 sc.group_of.size())
+                  .first->second;
+                sc.grouped.emplace_back(g, c);
               }
 
-              // Create the automaton states
-              unsigned length = succs.size();
-              for (unsigned j = 0; j < length; ++j)
+              std::sort(sc.grouped.begin(), sc.grouped.end());
+              size_t n = sc.grouped.size();
+              for (size_t k = 0; k < n; ++k)
               {
-                if (acc_succs[j])
+                unsigned g = sc.grouped[k].first;
+                rec.group_classes.push_back(sc.grouped[k].second);
+                if (k + 1 < n && sc.grouped[k + 1].first == g)
+                  continue;
+                rec.group_end.push_back(rec.group_classes.size());
+                unsigned first = rec.group_classes[g ? rec.group_end[g - 1]
+                                                     : 0];
+                ncsb_successors(ms, first, g, sc, rec);
+              }
+            }
+
+            // Adds to res_ the edges from `origin` recorded in `rec`,
+            // creating the new states in the order of the successors,
+            // with one edge for each destination and acceptance.
+            void
+            commit(unsigned origin, const ncsb_record& rec)
+            {
+              if (rec.sink)
+              {
+                bdd all = bddfalse;
+                for (unsigned i: rec.members)
+                  all |= compat_[i];
+                if (all != bddtrue)
                 {
-                  unsigned dst = new_state(std::move(succs[j]));
-                  res_->new_edge(origin, dst, letter, {0});
-                } else {
-                  unsigned dst = new_state(std::move(succs[j]));
-                  res_->new_edge(origin, dst, letter);
+                  mstate empty_state(4 * nw_, 0);
+                  out_.push_back({new_state(empty_state.data()), true,
+                                  !all});
                 }
               }
+
+              group_conds_.clear();
+              unsigned begin = 0;
+              for (unsigned end: rec.group_end)
+              {
+                bdd cond = bddfalse;
+                for (unsigned k = begin; k < end; ++k)
+                  cond |= psb_.num2bdd_[rec.group_classes[k]];
+                group_conds_.push_back(cond);
+                begin = end;
+              }
+
+              size_t size = 4 * nw_;
+              size_t length = rec.acc_succs.size();
+              for (size_t j = 0; j < length; ++j)
+                out_.push_back({new_state(rec.succs.data() + j * size),
+                                bool(rec.acc_succs[j]),
+                                group_conds_[rec.group_of_succ[j]]});
+
+              std::stable_sort(out_.begin(), out_.end(),
+                               [](const out_edge& a, const out_edge& b)
+                               {
+                                 return std::tie(a.dst, a.acc)
+                                   < std::tie(b.dst, b.acc);
+                               });
+              size_t n = out_.size();
+              for (size_t j = 0; j < n;)
+              {
+                bdd cond = out_[j].cond;
+                size_t k = j + 1;
+                for (; k < n && out_[k].dst == out_[j].dst
+                       && out_[k].acc == out_[j].acc; ++k)
+                  cond |= out_[k].cond;
+                if (out_[j].acc)
+                  res_->new_edge(origin, out_[j].dst, cond, {0});
+                else
+                  res_->new_edge(origin, out_[j].dst, cond);
+                j = k;
+              }
+              out_.clear();
+            }
+
+            // Same as the loop of run(), but computes the successors of
+            // the macrostates on threads_ threads.
+            //
+            // The states are processed in batches of consecutive states.
+            // The successors of all states of a batch are computed
+            // concurrently; this only reads mstates_, psb_, and the
+            // bitsets. Then the batch is committed state by state, in
+            // order, which creates the new states and edges exactly as
+            // the sequential loop does. The result does not depend on the
+            // number of threads.
+            void
+            run_parallel()
+            {
+              // Bounds the memory used by the successors of one batch
+              const unsigned max_batch = 1 << 12;
+
+              worker_pool pool(threads_);
+              std::vector<ncsb_scratch> scratch(pool.size());
+              std::vector<ncsb_record> records;
+              size_t size = 4 * nw_;
+              for (unsigned next = 0; next < hashes_.size();)
+              {
+                unsigned end = std::min<unsigned>(hashes_.size(),
+                                                  next + max_batch);
+                if (records.size() < end - next)
+                  records.resize(end - next);
+                const bits::word* first = mstates_.data() + next * size;
+                pool.run(end - next, [&](size_t i, unsigned t) {
+                    compute_successors(first + i * size, scratch[t],
+                                       records[i]);
+                  });
+                for (unsigned origin = next; origin < end; ++origin)
+                  commit(origin, records[origin - next]);
+                next = end;
+              }
             }
 
         public:
-            ncsb_complementation(const spot::const_twa_graph_ptr& aut, bool show_names)
+            ncsb_complementation(const spot::const_twa_graph_ptr& aut,
+                                 bool show_names, unsigned threads)
                     : aut_(aut),
                       si_(aut),
                       nb_states_(aut->num_states()),
-                      support_(nb_states_),
+                      nw_(bits::words_for(nb_states_)),
+                      threads_(threads > 0 ? threads
+                               : std::max(1u,
+                                          std::thread::hardware_concurrency())),
                       compat_(nb_states_),
-                      is_accepting_(nb_states_),
+                      is_deter_(nw_, 0),
+                      is_accepting_(nw_, 0),
+                      psb_(aut, sets_),
                       show_names_(show_names)
             {
               res_ = spot::make_twa_graph(aut->get_dict());
               res_->copy_ap_of(aut);
               res_->set_buchi();
+              buckets_.assign(16, -1U);
 
-              // Generate bdd supports and compatible options for each state.
-              // Also check if all its transitions are accepting.
+              // Generate compatible options for each state. Also check if
+              // all its transitions are accepting.
               for (unsigned i = 0; i < nb_states_; ++i)
               {
-                bdd res_support = bddtrue;
                 bdd res_compat = bddfalse;
                 bool accepting = true;
                 bool has_transitions = false;
                 for (const auto& out: aut->out(i))
                 {
                   has_transitions = true;
-                  res_support &= bdd_support(out.cond);
                   res_compat |= out.cond;
                   if (!out.acc)
                     accepting = false;
                 }
-                support_[i] = res_support;
                 compat_[i] = res_compat;
-                is_accepting_[i] = accepting && has_transitions;
+                if (accepting && has_transitions)
+                  bits::set(is_accepting_.data(), i);
               }
 
-
-
               // Compute which SCCs are part of the deterministic set.
-              is_deter_ = spot::semidet_sccs(si_);
+              std::vector<bool> deter_sccs = spot::semidet_sccs(si_);
+              for (unsigned i = 0; i < nb_states_; ++i)
+                if (deter_sccs[si_.scc_of(i)])
+                  bits::set(is_deter_.data(), i);
 
               if (show_names_)
               {
@@ -456,9 +642,9 @@ namespace from_spot
               // belongs to the N set. (otherwise the automaton would be
               // deterministic)
               unsigned init_state = aut->get_init_state_number();
-              mstate new_init_state(nb_states_, ncsb_m);
-              new_init_state[init_state] = ncsb_n;
-              res_->set_init_state(new_state(std::move(new_init_state)));
+              mstate new_init_state(4 * nw_, 0);
+              bits::set(new_init_state.data(), init_state);
+              res_->set_init_state(new_state(new_init_state.data()));
             }
 
             spot::twa_graph_ptr
@@ -466,59 +652,22 @@ namespace from_spot
             {
               // Main stuff happens here
 
-              while (!todo_.empty())
+              if (threads_ > 1)
               {
-                auto top = todo_.front();
-                todo_.pop_front();
-
-                mstate ms = top.first;
-
-                // Compute support of all available states.
-                bdd msupport = bddtrue;
-                bdd n_s_compat = bddfalse;
-                bdd c_compat = bddtrue;
-                bool c_empty = true;
-                for (unsigned i = 0; i < nb_states_; ++i)
-                  if (ms[i] != ncsb_m)
-                  {
-                    msupport &= support_[i];
-                    // PLDI: add ms[i] == ncsb_c as those states could be also virtually in S
-                    if (ms[i] == ncsb_n || ms[i] == ncsb_s || ms[i] == ncsb_c || is_accepting_[i])
-                      n_s_compat |= compat_[i];
-                    else
-                    {
-                      c_empty = false;
-                      c_compat &= compat_[i];
-                    }
-                  }
-
-                bdd all;
-                if (!c_empty)
-                  all = c_compat;
-                else
-                {
-                  all = n_s_compat;
-                  if (all != bddtrue)
-                  {
-                    mstate empty_state(nb_states_, ncsb_m);
-                    res_->new_edge(top.second,
-                                   new_state(std::move(empty_state)),
-                                   !all,
-                                   {0});
-                  }
-                }
-                while (all != bddfalse)
-                {
-                  bdd one = bdd_satoneset(all, msupport, bddfalse);
-                  all -= one;
-
-                  // Compute all new states available from the generated
-                  // letter.
-                  ncsb_successors(std::move(ms), top.second, one);
-                }
+                run_parallel();
+                return res_;
               }
 
-              res_->merge_edges();
+              ncsb_scratch scratch;
+              ncsb_record record;
+              size_t size = 4 * nw_;
+              // commit() may reallocate mstates_, but only reads record
+              for (unsigned origin = 0; origin < hashes_.size(); ++origin)
+              {
+                compute_successors(mstates_.data() + origin * size,
+                                   scratch, record);
+                commit(origin, record);
+              }
               return res_;
             }
         };
@@ -526,16 +675,14 @@ namespace from_spot
     }
 
     spot::twa_graph_ptr
-    complement_semidet(const spot::const_twa_graph_ptr& aut, bool show_names)
+    complement_semidet(const spot::const_twa_graph_ptr& aut, bool show_names,
+                       unsigned threads)
     {
       if (!is_semi_deterministic(aut))
         throw std::runtime_error
                 ("complement_semidet() requires a semi-deterministic input");
 
-      auto ncsb = ncsb_complementation(aut, show_names);
+      auto ncsb = ncsb_complementation(aut, show_names, threads);
       return ncsb.run();
     }
 }
-
-
-
@@ -139,7 +139,8 @@ bool is_cut_deterministic(const_aut_ptr aut, std::set<unsigned>* non_det_states)
     return cut_det;
 }
 
-aut_ptr determinize_first_component(const_aut_ptr src, state_set * to_determinize)
+aut_ptr determinize_first_component(const_aut_ptr src, state_set * to_determinize,
+                                    const resource_budget* budget)
 {
   auto res = spot::make_twa_graph(src->get_dict());
   res->copy_ap_of(src);
@@ -147,52 +148,69 @@ aut_ptr determinize_first_component(const_aut_ptr src, state_set * to_determiniz
   auto names = new std::vector<std::string>;
 
   // Setup the powerset construction
+  state_set_table sets;
   auto ps2num = std::unique_ptr<power_map>(new power_map);
   auto num2ps = std::unique_ptr<succ_vect>(new succ_vect);
-  auto psb = std::unique_ptr<powerset_builder>(new powerset_builder(src));
+  auto psb = std::unique_ptr<powerset_builder>
+    (new powerset_builder(src, sets, true, budget));
 
   // returns the state`s index, creates a new state if needed
-  auto get_state = [&](state_set ps) {
-    if (ps2num->count(ps) == 0)
+  auto get_state = [&](set_id ps) {
+    state_t found = ps2num->get(ps);
+    if (found == power_map::none)
     {
       // create a new state
       assert(num2ps->size() == res->num_states());
       num2ps->emplace_back(ps);
       auto state = res->new_state();
-      (*ps2num)[ps] = state;
+      ps2num->insert(ps, state);
       //TODO add to bp1 states
 
-      names->emplace_back(powerset_name(&ps));
+      names->emplace_back(powerset_name(sets, ps));
       return state;
     } else
-      return ps2num->at(ps);
+      return found;
 
   };
 
   // Set the initial state
   state_t init_num = src->get_init_state_number();
-  state_set ps{init_num};
-  res->set_init_state(get_state(ps));
+  res->set_init_state(get_state(sets.intern(&init_num, &init_num + 1)));
+
+  // Bitsets of the states to determinize and of the remaining states
+  auto fc_mask = psb->state_mask(to_determinize->begin(),
+                                 to_determinize->end());
+  state_vect others;
+  for (state_t s = 0; s < src->num_states(); ++s)
+    if (to_determinize->count(s) == 0)
+      others.push_back(s);
+  auto sc_mask = psb->state_mask(others.begin(), others.end());
+  succ_buffer buf;
 
   // Compute powerset with respect to to_determinize
   for (state_t s = 0; s < res->num_states(); ++s)
   {
+    if (budget && (s & 255) == 0)
+      budget->check(res->num_states(),
+                    sets.memory_usage() + ps2num->memory_usage()
+                    + psb->memory_usage()
+                    + res->num_edges() * sizeof(edge_t));
     auto ps = num2ps->at(s);
-    auto succs = std::unique_ptr<succ_vect>(psb->get_succs(&ps,
-                                            to_determinize->begin(),
-                                            to_determinize->end()));
-    for(size_t c = 0; c < psb->nc_; ++c)
+    psb->succs(ps, fc_mask.data(), buf);
+    // Transitions to ∅ are skipped
+    for (unsigned c = buf.next(0); c < psb->nc_; c = buf.next(c + 1))
     {
       auto cond = psb->num2bdd_[c];
-      auto d_ps = succs->at(c);
-      // Skip transitions to ∅
-      if (d_ps == empty_set)
-        continue;
+      auto d_ps = sets.intern_bits(buf.row(c), buf.nw);
       auto dst = get_state(d_ps);
       res->new_edge(s, dst, cond);
     }
   }
 
+  if (budget)
+    budget->check_states(res->num_states() + src->num_states()
+                         - to_determinize->size());
+
   // remeber for later stop iteration when adding cut transitions
   auto lsize = res->num_states();
 
@@ -221,20 +239,15 @@ aut_ptr determinize_first_component(const_aut_ptr src, state_set * to_determiniz
   for (state_t ns = 0; ns < lsize; ns++)
   {
     auto ps = num2ps->at(ns);
-    auto succs = std::unique_ptr<succ_vect>(psb->get_succs(&ps,
-                                            to_determinize->begin(),
-                                            to_determinize->end(),
-                                            true
-                                           ));
-    for(size_t c = 0; c < psb->nc_; ++c)
+    psb->succs(ps, sc_mask.data(), buf);
+    // Transitions to ∅ are skipped
+    for (unsigned c = buf.next(0); c < psb->nc_; c = buf.next(c + 1))
     {
       auto cond = psb->num2bdd_[c];
-      auto d_ps = succs->at(c);
-      // Skip transitions to ∅
-      if (d_ps == empty_set)
-        continue;
-      for (auto s : d_ps)
-        res->new_edge(ns, old2new[s], cond);
+      const bits::word* row = buf.row(c);
+      for (size_t d = bits::find_next(row, buf.nw, 0); d < buf.nw * 64;
+           d = bits::find_next(row, buf.nw, d + 1))
+        res->new_edge(ns, old2new[d], cond);
     }
   }
 
@@ -26,8 +26,11 @@
 /**
  * Determinizes the first part of input. The first part is given by to_determinize
  * that can be obtained by `is_cut_deterministic`. Returns a new automaton.
+ *
+ * Throws budget_exceeded if the construction exceeds `budget` (if given).
  */
-aut_ptr determinize_first_component(const_aut_ptr, state_set * to_determinize);
+aut_ptr determinize_first_component(const_aut_ptr, state_set * to_determinize,
+                                    const resource_budget* budget = nullptr);
 
 
 /**
@@ -0,0 +1,540 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+
+#include <spot/twa/twaproduct.hh>
+#include <spot/twaalgos/degen.hh>
+#include <spot/twaalgos/isdet.hh>
+#include <spot/twaalgos/minimize.hh>
+#include <spot/twaalgos/sccfilter.hh>
+#include <spot/twaalgos/sccinfo.hh>
+#include <spot/twaalgos/word.hh>
+
+#include <seminator.hpp>
+#include <lazy_twa.hpp>
+#include <statemap.hpp>
+
+namespace
+{
+  // A macrostate of the NCSB complementation: the sets N, C, S, and B
+  // (with B included in C) of states of the semi-deterministic automaton,
+  // given by the numbers of ncsb_lazy_twa, each one sorted.
+  struct macrostate
+  {
+    std::vector<unsigned> n, c, s, b;
+
+    bool operator<(const macrostate& o) const
+    {
+      return std::tie(n, c, s, b) < std::tie(o.n, o.c, o.s, o.b);
+    }
+
+    bool operator==(const macrostate& o) const
+    {
+      return n == o.n && c == o.c && s == o.s && b == o.b;
+    }
+  };
+
+  bool contains(const std::vector<unsigned>& set, unsigned i)
+  {
+    return std::binary_search(set.begin(), set.end(), i);
+  }
+
+  void sort_unique(std::vector<unsigned>& set)
+  {
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+  }
+
+  // A copy of `ms` with the state `i` moved from C (and B) to S
+  macrostate moved_to_s(const macrostate& ms, unsigned i)
+  {
+    macrostate res = ms;
+    res.c.erase(std::find(res.c.begin(), res.c.end(), i));
+    auto it = std::find(res.b.begin(), res.b.end(), i);
+    if (it != res.b.end())
+      res.b.erase(it);
+    res.s.insert(std::upper_bound(res.s.begin(), res.s.end(), i), i);
+    return res;
+  }
+
+  class ncsb_lazy_state : public spot::state
+  {
+    public:
+      explicit ncsb_lazy_state(macrostate ms)
+        : ms_(std::move(ms))
+      {
+      }
+
+      const macrostate& get() const
+      {
+        return ms_;
+      }
+
+      int compare(const spot::state* other) const override
+      {
+        auto& o = static_cast<const ncsb_lazy_state*>(other)->ms_;
+        return ms_ < o ? -1 : (o < ms_ ? 1 : 0);
+      }
+
+      size_t hash() const override
+      {
+        uint64_t h = 0;
+        for (auto* set: {&ms_.n, &ms_.c, &ms_.s, &ms_.b})
+          {
+            for (unsigned i: *set)
+              h = mix_hash(h ^ i);
+            h = mix_hash(h + 1);
+          }
+        return h;
+      }
+
+      ncsb_lazy_state* clone() const override
+      {
+        return new ncsb_lazy_state(ms_);
+      }
+
+    private:
+      macrostate ms_;
+  };
+
+  struct ncsb_edge
+  {
+    bdd cond;
+    macrostate dst;
+    bool acc;
+  };
+
+  class ncsb_lazy_succ_iterator : public spot::twa_succ_iterator
+  {
+    public:
+      explicit ncsb_lazy_succ_iterator(std::vector<ncsb_edge>&& edges)
+        : edges_(std::move(edges))
+      {
+      }
+
+      bool first() override
+      {
+        pos_ = 0;
+        return pos_ < edges_.size();
+      }
+
+      bool next() override
+      {
+        return ++pos_ < edges_.size();
+      }
+
+      bool done() const override
+      {
+        return pos_ >= edges_.size();
+      }
+
+      const spot::state* dst() const override
+      {
+        return new ncsb_lazy_state(edges_[pos_].dst);
+      }
+
+      bdd cond() const override
+      {
+        return edges_[pos_].cond;
+      }
+
+      acc_mark acc() const override
+      {
+        return edges_[pos_].acc ? acc_mark({0}) : acc_mark();
+      }
+
+    private:
+      std::vector<ncsb_edge> edges_;
+      size_t pos_ = 0;
+  };
+
+  /*
+  * The NCSB complement (with the PLDI'18 optimization, as in
+  * complement.cpp) of a semi-deterministic Büchi automaton given as a
+  * spot::twa, explored on the fly.
+  *
+  * `deterministic` tells which states of `sd` are in its deterministic
+  * part, which must be closed under successors and contain all the
+  * accepting edges that can be seen infinitely often. The states of
+  * `sd` are numbered in the order in which they are first reached, and
+  * their edges are read when a macrostate containing them is expanded.
+  */
+  class ncsb_lazy_twa : public spot::twa
+  {
+    public:
+      typedef std::function<bool(const spot::state*)> predicate;
+
+      ncsb_lazy_twa(spot::const_twa_ptr sd, predicate deterministic)
+        : spot::twa(sd->get_dict()),
+          sd_(sd),
+          deterministic_(deterministic)
+      {
+        copy_ap_of(sd);
+        set_buchi();
+      }
+
+      ~ncsb_lazy_twa()
+      {
+        for (auto* st: states_)
+          st->destroy();
+      }
+
+      const spot::state* get_init_state() const override
+      {
+        macrostate ms;
+        ms.n.push_back(number(sd_->get_init_state()));
+        return new ncsb_lazy_state(ms);
+      }
+
+      spot::twa_succ_iterator* succ_iter(const spot::state* s) const override;
+
+      std::string format_state(const spot::state* s) const override
+      {
+        auto& ms = static_cast<const ncsb_lazy_state*>(s)->get();
+        std::string res;
+        for (auto* set: {&ms.n, &ms.c, &ms.s, &ms.b})
+          {
+            res += res.empty() ? "{" : ",{";
+            for (unsigned i: *set)
+              {
+                if (res.back() != '{')
+                  res += ",";
+                res += std::to_string(i);
+              }
+            res += "}";
+          }
+        return res;
+      }
+
+    private:
+      struct sd_edge
+      {
+        bdd cond;
+        unsigned dst;
+        bool acc;
+      };
+
+      struct sd_info
+      {
+        bool deterministic;
+        bool explored = false;
+        // Only has accepting edges (and at least one)
+        bool accepting = false;
+        // Union of the labels of the edges
+        bdd compat = bddfalse;
+        std::vector<sd_edge> edges;
+      };
+
+      // The number of the state `s` of sd_, which this object owns
+      unsigned number(const spot::state* s) const
+      {
+        auto it = numbers_.find(s);
+        if (it != numbers_.end())
+          {
+            s->destroy();
+            return it->second;
+          }
+        unsigned res = states_.size();
+        states_.push_back(s);
+        info_.emplace_back();
+        info_.back().deterministic = deterministic_(s);
+        numbers_.emplace(s, res);
+        return res;
+      }
+
+      // The information about the state `i`, whose edges are read on
+      // the first call. (info_ is a deque, so the references stay
+      // valid when new states are numbered.)
+      const sd_info& explore(unsigned i) const
+      {
+        if (info_[i].explored)
+          return info_[i];
+        std::vector<sd_edge> edges;
+        bool accepting = true;
+        bdd compat = bddfalse;
+        spot::twa_succ_iterator* it = sd_->succ_iter(states_[i]);
+        if (it->first())
+          do
+            {
+              bool acc = bool(it->acc());
+              edges.push_back({it->cond(), number(it->dst()), acc});
+              compat |= it->cond();
+              accepting &= acc;
+            }
+          while (it->next());
+        sd_->release_iter(it);
+        sd_info& info = info_[i];
+        info.explored = true;
+        info.accepting = accepting && !edges.empty();
+        info.compat = compat;
+        info.edges = std::move(edges);
+        return info;
+      }
+
+      bool accepting(unsigned i) const
+      {
+        return explore(i).accepting;
+      }
+
+      // The successors of `ms` under the letters of `letters`, all of
+      // which select the same edges from the states of `ms`, appended
+      // to `out`.
+      void successors(const macrostate& ms, const bdd& letters,
+                      std::vector<ncsb_edge>& out) const;
+
+      spot::const_twa_ptr sd_;
+      predicate deterministic_;
+      mutable std::vector<const spot::state*> states_;
+      mutable std::deque<sd_info> info_;
+      mutable spot::state_map<unsigned> numbers_;
+  };
+
+  void
+  ncsb_lazy_twa::successors(const macrostate& ms, const bdd& letters,
+                            std::vector<ncsb_edge>& out) const
+  {
+    // Calls f on the edges of `i` taken by `letters`
+    auto on = [&](unsigned i, auto f)
+      {
+        for (auto& e: explore(i).edges)
+          if ((e.cond & letters) != bddfalse)
+            f(e);
+      };
+
+    // Handle S states; an accepting edge from a safe state (or to an
+    // accepting state) is forbidden.
+    macrostate next;
+    bool forbidden = false;
+    for (unsigned i: ms.s)
+      on(i, [&](const sd_edge& e)
+         {
+           if (e.acc || accepting(e.dst))
+             forbidden = true;
+           next.s.push_back(e.dst);
+         });
+    if (forbidden)
+      return;
+    sort_unique(next.s);
+
+    // Handle C and N states. PLDI: All states from 2nd component go to C
+    // only, and the states already in S' are removed from C'.
+    for (unsigned i: ms.c)
+      on(i, [&](const sd_edge& e) { next.c.push_back(e.dst); });
+    for (unsigned i: ms.n)
+      on(i, [&](const sd_edge& e)
+         {
+           if (explore(e.dst).deterministic)
+             next.c.push_back(e.dst);
+           else
+             next.n.push_back(e.dst);
+         });
+    sort_unique(next.n);
+    sort_unique(next.c);
+    next.c.erase(std::remove_if(next.c.begin(), next.c.end(),
+                                [&](unsigned i)
+                                {
+                                  return contains(next.s, i);
+                                }), next.c.end());
+
+    // PLDI: Handle B states. A non-accepting state of B without
+    // successor, or with a non-accepting edge to S', has no successor.
+    std::vector<unsigned> post_b;
+    for (unsigned i: ms.b)
+      {
+        bool has_succ = false;
+        on(i, [&](const sd_edge& e)
+           {
+             has_succ = true;
+             if (!e.acc && contains(next.s, e.dst))
+               forbidden = true;
+             post_b.push_back(e.dst);
+           });
+        if (forbidden || (!has_succ && !accepting(i)))
+          return;
+      }
+    sort_unique(post_b);
+    std::set_intersection(post_b.begin(), post_b.end(),
+                          next.c.begin(), next.c.end(),
+                          std::back_inserter(next.b));
+
+    std::vector<macrostate> succs{next};
+    std::vector<bool> acc_succs{false};
+
+    // Allow to move accepting dst to S'
+    for (unsigned i: ms.b)
+      on(i, [&](const sd_edge& e)
+         {
+           if (!e.acc || accepting(e.dst))
+             return;
+           // double all the current possible states
+           size_t length = succs.size();
+           for (size_t j = 0; j < length; ++j)
+             if (contains(succs[j].b, e.dst))
+               {
+                 succs.push_back(moved_to_s(succs[j], e.dst));
+                 acc_succs.push_back(false);
+               }
+         });
+
+    // PLDI: For each possible successor check if B' might be empty. If
+    // yes, move C' to B' and make the edge accepting, and add the clones
+    // where any subset of the non-accepting states of C' is moved to S'
+    // (with accepting edges as well).
+    size_t length = succs.size();
+    for (size_t j = 0; j < length; ++j)
+      {
+        if (!succs[j].b.empty())
+          continue;
+        succs[j].b = succs[j].c;
+        acc_succs[j] = true;
+        size_t first_clone = succs.size();
+        std::vector<unsigned> b = succs[j].b;
+        for (unsigned i: b)
+          {
+            if (accepting(i))
+              continue;
+            size_t k_length = succs.size();
+            succs.push_back(moved_to_s(succs[j], i));
+            acc_succs.push_back(true);
+            for (size_t k = first_clone; k < k_length; ++k)
+              {
+                succs.push_back(moved_to_s(succs[k], i));
+                acc_succs.push_back(true);
+              }
+          }
+      }
+
+    for (size_t j = 0; j < succs.size(); ++j)
+      out.push_back({letters, std::move(succs[j]), acc_succs[j]});
+  }
+
+  spot::twa_succ_iterator*
+  ncsb_lazy_twa::succ_iter(const spot::state* s) const
+  {
+    auto& ms = static_cast<const ncsb_lazy_state*>(s)->get();
+    std::vector<ncsb_edge> out;
+
+    // The letters that need a successor: those compatible with all
+    // non-accepting states of B if there is one (PLDI: the other states
+    // of C could be also virtually in S), and those compatible with any
+    // state otherwise. The other letters lead to the empty macrostate,
+    // which accepts everything.
+    bdd all = bddtrue;
+    bool checked = false;
+    for (unsigned i: ms.b)
+      if (!accepting(i))
+        {
+          checked = true;
+          all &= explore(i).compat;
+        }
+    if (!checked)
+      {
+        all = bddfalse;
+        for (auto* set: {&ms.n, &ms.c, &ms.s})
+          for (unsigned i: *set)
+            all |= explore(i).compat;
+        if (all != bddtrue)
+          out.push_back({!all, macrostate(), true});
+      }
+
+    // Partition `all` by the labels of the edges of the states of the
+    // macrostate, so that the letters of a class take the same edges.
+    std::vector<bdd> classes;
+    if (all != bddfalse)
+      classes.push_back(all);
+    for (auto* set: {&ms.n, &ms.c, &ms.s})
+      for (unsigned i: *set)
+        for (auto& e: explore(i).edges)
+          {
+            unsigned n = classes.size();
+            for (unsigned k = 0; k < n; ++k)
+              {
+                bdd in = classes[k] & e.cond;
+                if (in == bddfalse || in == classes[k])
+                  continue;
+                classes.emplace_back(classes[k] - e.cond);
+                classes[k] = in;
+              }
+          }
+
+    for (auto& letters: classes)
+      successors(ms, letters, out);
+    return new ncsb_lazy_succ_iterator(std::move(out));
+  }
+}
+
+spot::twa_word_ptr
+inclusion_counterexample(spot::const_twa_graph_ptr a,
+                         spot::const_twa_graph_ptr b,
+                         const spot::option_map* opt)
+{
+  if (a->get_dict() != b->get_dict())
+    throw std::runtime_error("inclusion_counterexample() requires automata "
+                             "with the same bdd_dict");
+  if (!a->acc().is_generalized_buchi() || !b->acc().is_generalized_buchi())
+    throw std::runtime_error("inclusion_counterexample() requires TGBA");
+
+  // b is normalized as by semi_determinize(): "t" automata are minimized
+  // as DFA, and a semi-deterministic b is complemented as it is.
+  auto sb = spot::scc_filter(b, true);
+  if (sb->acc().is_all())
+    sb = spot::minimize_monitor(sb);
+
+  std::shared_ptr<ncsb_lazy_twa> comp;
+  if (spot::is_semi_deterministic(sb))
+    {
+      // The NCSB construction needs a Büchi automaton
+      if (sb->acc().is_all())
+        {
+          sb->set_buchi();
+          for (auto& e: sb->edges())
+            e.acc = acc_mark({0});
+        }
+      else if (!sb->acc().is_buchi())
+        sb = spot::scc_filter(spot::degeneralize_tba(sb), true);
+      // Its deterministic part is made of the semi-deterministic SCCs
+      spot::scc_info si(sb);
+      std::vector<bool> semidet = spot::semidet_sccs(si);
+      std::vector<bool> deterministic(sb->num_states());
+      for (unsigned s = 0; s < sb->num_states(); ++s)
+        deterministic[s] = semidet[si.scc_of(s)];
+      comp = std::make_shared<ncsb_lazy_twa>
+        (sb, [sb, deterministic](const spot::state* s)
+             {
+               return deterministic[sb->state_number(s)];
+             });
+    }
+  else
+    {
+      // The deterministic SCCs of b are not reused with their own
+      // acceptance, which the NCSB construction would not handle.
+      spot::option_map om;
+      if (opt)
+        om = *opt;
+      om.set("reuse-deterministic", 0);
+      auto sd = std::make_shared<bp_lazy_twa>(sb, false, &om);
+      comp = std::make_shared<ncsb_lazy_twa>
+        (sd, &bp_lazy_twa::in_second_component);
+    }
+  return spot::otf_product(a, comp)->accepting_word();
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <lazy_twa.hpp>
+#include <seminator.hpp>
+
+#include <stdexcept>
+#include <tuple>
+
+#include <spot/twaalgos/isdet.hh>
+#include <spot/twaalgos/minimize.hh>
+#include <spot/twaalgos/sccfilter.hh>
+
+int
+bp_lazy_state::compare(const spot::state* other) const
+{
+  auto& o = static_cast<const bp_lazy_state*>(other)->st_;
+  auto key = [](const sd_state& st) {
+    return std::make_tuple(st.type, st.level, st.p, st.q, st.s);
+  };
+  auto a = key(st_);
+  auto b = key(o);
+  return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+size_t
+bp_lazy_state::hash() const
+{
+  uint64_t pq = (uint64_t(st_.p) << 32) | st_.q;
+  uint64_t ts = (uint64_t(st_.type) << 32) ^ st_.s ^ (uint64_t(st_.level) << 40);
+  return mix_hash(pq ^ mix_hash(ts));
+}
+
+bp_lazy_state*
+bp_lazy_state::clone() const
+{
+  return new bp_lazy_state(st_);
+}
+
+namespace
+{
+  // Iterates over the edges computed by bp_twa::successors()
+  class bp_lazy_succ_iterator : public spot::twa_succ_iterator
+  {
+    public:
+      explicit bp_lazy_succ_iterator(std::vector<sd_edge>&& edges)
+        : edges_(std::move(edges))
+      {
+      }
+
+      bool first() override
+      {
+        pos_ = 0;
+        return pos_ < edges_.size();
+      }
+
+      bool next() override
+      {
+        return ++pos_ < edges_.size();
+      }
+
+      bool done() const override
+      {
+        return pos_ >= edges_.size();
+      }
+
+      const spot::state* dst() const override
+      {
+        return new bp_lazy_state(edges_[pos_].dst);
+      }
+
+      bdd cond() const override
+      {
+        return edges_[pos_].cond;
+      }
+
+      acc_mark acc() const override
+      {
+        return edges_[pos_].acc;
+      }
+
+    private:
+      std::vector<sd_edge> edges_;
+      size_t pos_ = 0;
+  };
+}
+
+bp_lazy_twa::bp_lazy_twa(const_aut_ptr src_aut, bool cut_det,
+                         const_om_ptr om)
+  : spot::twa(src_aut->get_dict()),
+    core_(new bp_twa(src_aut, cut_det, om, false))
+{
+  copy_ap_of(src_aut);
+  copy_acceptance_of(core_->res_aut());
+  prop_semi_deterministic(true);
+}
+
+const spot::state*
+bp_lazy_twa::get_init_state() const
+{
+  return new bp_lazy_state(core_->initial_state());
+}
+
+spot::twa_succ_iterator*
+bp_lazy_twa::succ_iter(const spot::state* s) const
+{
+  std::vector<sd_edge> edges;
+  core_->successors(static_cast<const bp_lazy_state*>(s)->get(), edges);
+  return new bp_lazy_succ_iterator(std::move(edges));
+}
+
+std::string
+bp_lazy_twa::format_state(const spot::state* s) const
+{
+  return core_->state_name(static_cast<const bp_lazy_state*>(s)->get());
+}
+
+bool
+bp_lazy_twa::in_second_component(const spot::state* s)
+{
+  auto type = static_cast<const bp_lazy_state*>(s)->get().type;
+  return type == State_type::BP2 || type == State_type::PS2
+    || type == State_type::REUSED2;
+}
+
+spot::twa_ptr
+semi_determinize_lazy(spot::const_twa_graph_ptr aut, bool cut_det,
+                      const spot::option_map* opt)
+{
+  if (!aut->acc().is_generalized_buchi())
+    throw std::runtime_error("semi_determinize_lazy() requires a TGBA");
+  auto input = spot::scc_filter(aut, true);
+  // As in seminator::process_job(): the breakpoint construction needs at
+  // least one acceptance set, and builds nothing from an initial SCC that
+  // it avoids, so "t" automata are minimized as DFA, and automata that
+  // are already semi-deterministic are not semi-determinized again.
+  if (input->acc().is_all())
+    input = spot::minimize_monitor(input);
+  state_set non_det_states;
+  if (spot::is_deterministic(input) ||
+      is_cut_deterministic(input, &non_det_states))
+    return input;
+  if (spot::is_semi_deterministic(input))
+    return cut_det ? determinize_first_component(input, &non_det_states)
+                   : input;
+  // Without options, bp_twa would disable the optimizations that
+  // semi_determinize() enables by default
+  static const spot::option_map no_options;
+  return std::make_shared<bp_lazy_twa>(input, cut_det,
+                                       opt ? opt : &no_options);
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <memory>
+
+#include <types.hpp>
+#include <breakpoint_twa.hpp>
+
+/*
+* State of a bp_lazy_twa: a copy of an sd_state of its bp_twa
+*/
+class bp_lazy_state : public spot::state
+{
+  public:
+    explicit bp_lazy_state(const sd_state& st)
+      : st_(st)
+    {
+    }
+
+    const sd_state& get() const
+    {
+      return st_;
+    }
+
+    int compare(const spot::state* other) const override;
+    size_t hash() const override;
+    bp_lazy_state* clone() const override;
+
+  private:
+    sd_state st_;
+};
+
+/*
+* The automaton built by bp_twa, explored on the fly.
+*
+* The successors of a state are computed by bp_twa::successors() when
+* the state is first visited by the algorithm using the automaton, and
+* nothing is stored apart from the interned sets of states. Unlike
+* bp_twa::res_aut(), the edges are not merged and jump-to-bottommost is
+* not applied.
+*/
+class bp_lazy_twa : public spot::twa
+{
+  public:
+    bp_lazy_twa(const_aut_ptr src_aut, bool cut_det, const_om_ptr om);
+
+    const spot::state* get_init_state() const override;
+    spot::twa_succ_iterator* succ_iter(const spot::state* s) const override;
+    std::string format_state(const spot::state* s) const override;
+
+    // Whether the state `s` of this automaton is in the 2nd
+    // (deterministic) component
+    static bool in_second_component(const spot::state* s);
+
+  private:
+    // successors() interns sets, hence the pointer
+    std::unique_ptr<bp_twa> core_;
+};
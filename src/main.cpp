@@ -20,6 +20,15 @@
 #include <unistd.h>
 #include "seminator.hpp"
 #include "cutdet.hpp"
+#include "cache.hpp"
+#include "subprocess.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <system_error>
 #include <spot/parseaut/public.hh>
 #include <spot/twaalgos/hoa.hh>
 #include <spot/twaalgos/sccfilter.hh>
@@ -50,7 +59,8 @@ Output options:
     --complement[=best|spot|pldi]
                 build a semi-deterministic automaton to complement it using
                 the NCSB implementation of Spot, or the PLDI'18 variant
-                implemented in Seminator
+                implemented in Seminator; best (the default) runs both
+                concurrently and keeps the smaller result
 
     --ba        SBA output
     --tba       TBA output
@@ -62,6 +72,11 @@ Output options:
     --is-cd     do not run transformation, check whether input is
                 cut-deterministic. Outputs only the cut-deterministic inputs.
                 (Spot's autfilt offers --is-semideterministic check)
+    --included-in=FILE
+                do not run transformation, check whether the language of
+                each input is included in that of the (first) automaton of
+                FILE, on the fly. Outputs "included", or "counterexample:"
+                followed by a word of the input rejected by FILE.
 
 Transformation type (T=transition-based, S=state-based):
     --via-tgba  one-step semi-determinization: TGBA -> sDBA
@@ -71,6 +86,14 @@ Transformation type (T=transition-based, S=state-based):
   Multiple translation types can be chosen, the one with smallest
   result will be outputted. If none is chosen, all three are run.
 
+    --cutoff-factor=K   abandon a type whose result, before the simplifications,
+                        has more than K times as many states as the best result
+                        so far (0 = never, default); also applies to the two
+                        complementations of --complement=best
+    --predict-jobs[=K]  predict the size of the result of each type from a
+                        sample of its construction, and run only the K types
+                        (1 by default) with the smallest predictions
+
 Cut-edges construction:
     --cut-always        cut-edges for each edge to an accepting SCC
                         (default, unless --pure)
@@ -96,14 +119,18 @@ Optimizations:
     --skip-levels[=0|1]         allow multiple breakpoints on 1 edge; a trick
                                 well known from degeneralization
     --scc-aware[=0|1]           scc-aware optimizations
+    --simulation-pruning[=0|1]  remove from the breakpoint states the input
+                                states simulated by other states (needs
+                                quadratic memory in the number of input
+                                states)
     --scc0, --no-scc-aware      same as --scc-aware=0
     --pure                      disable all optimizations except --scc-aware,
                                 also disable pre and post processings and
                                 implies --cut-highest-mark by default
 
   Pass 1 (or nothing) to enable, or 0 to disable.  All optimizations
-  are enabled by default, unless --pure is specified, in which case
-  only --scc-aware is on.
+  except --simulation-pruning are enabled by default, unless --pure is
+  specified, in which case only --scc-aware is on.
 
 Pre- and Post-processing:
     --preprocess[=0|1]       simplify the input automaton
@@ -114,12 +141,125 @@ Pre- and Post-processing:
     -s0, --no-reductions     same as --postprocess=0 --preprocess=0
                              --postprocess-comp=0
 
+Parallelism:
+    --threads=N   compute the successors of the 2nd component (and of the
+                  macrostates of --complement=pldi) on N threads (0 = one
+                  per core); the result does not depend on N
+    --scc-decompose[=0|1]
+                  build the 2nd component separately (and in parallel with
+                  --threads) for each SCC of the input; needs --scc-aware
+    -j N, --jobs=N
+                  process N input automata at a time in worker processes
+                  (0 = one per core); the results are output in the order
+                  of the input
+    --parallel-jobs[=0|1]
+                  run the transformation types (see --via-tgba, ...) in
+                  parallel worker processes; the result is the same
+
+Resource limits:
+    --max-states=N    abandon a job whose result exceeds N states
+    --max-memory=MIB  abandon a job whose construction needs more than MIB
+                      mebibytes (as estimated by its data structures)
+    --time-limit=SEC  abandon the jobs still running SEC seconds after the
+                      processing of an automaton started
+
+  The smallest result of the other jobs is output.  If all jobs of an
+  automaton are abandoned, an error is reported, the automaton is
+  skipped, and the exit status is 1.  All limits are off by default.
+
+Cache:
+    --cache-dir=DIR   keep the results in the directory DIR, and reuse them
+                      when the same automaton is processed again with the same
+                      options (and the same versions of Seminator and Spot)
+    --cache-size=MIB  remove the least recently used results when DIR grows
+                      over MIB mebibytes (default: no limit)
+
 Miscellaneous options:
   -h, --help    print this help
   --version     print program version
 )";
 }
 
+// Complements `aut` with the NCSB constructions of Spot and of
+// Seminator, simplifies both results with `postprocessor`, and returns the
+// smaller one (Spot's on ties). The two constructions run concurrently in
+// child processes, or one after the other if the processes cannot be
+// created. If one child process fails, the result of the other is
+// returned.
+//
+// With `cutoff` > 0, a construction whose result, before the
+// simplifications, has more than `cutoff` times as many states as the
+// simplified result of the other one (if it is already finished) is
+// abandoned.
+static spot::twa_graph_ptr
+complement_best(const spot::twa_graph_ptr& aut,
+                spot::postprocessor& postprocessor,
+                unsigned threads, int cutoff)
+{
+  shared_minimum best_size;
+  auto variant = [&](unsigned v) -> spot::twa_graph_ptr
+    {
+      spot::twa_graph_ptr comp = v == 0
+        ? spot::complement_semidet(aut)
+        : from_spot::complement_semidet(aut, false, threads);
+      unsigned best = best_size.get();
+      if (cutoff > 0 && best != -1U
+          && comp->num_states() > uint64_t(cutoff) * best)
+        return nullptr;
+      comp = postprocessor.run(comp);
+      best_size.update(comp->num_states());
+      return comp;
+    };
+
+  spot::twa_graph_ptr results[2];
+  std::vector<std::unique_ptr<child_process>> children;
+  try
+    {
+      for (unsigned v = 0; v < 2; ++v)
+        children.emplace_back(new child_process([&, v]()
+          {
+            auto res = variant(v);
+            return res ? 'A' + automaton_to_string(res) : "C";
+          }));
+    }
+  catch (const std::system_error&)
+    {
+      // Kills the child that may have been created
+      children.clear();
+    }
+
+  if (children.empty())
+    for (unsigned v = 0; v < 2; ++v)
+      results[v] = variant(v);
+  else
+    {
+      read_all({children[0].get(), children[1].get()});
+      // A child that fails (crashes, is killed, or throws) leaves the
+      // result of the other one, if any
+      std::exception_ptr failed = nullptr;
+      for (unsigned v = 0; v < 2; ++v)
+        try
+          {
+            std::string out = children[v]->finish();
+            if (out[0] == 'A')
+              results[v] = automaton_from_string(out.substr(1),
+                                                 aut->get_dict());
+          }
+        catch (const std::runtime_error&)
+          {
+            if (!failed)
+              failed = std::current_exception();
+          }
+      if (failed && !results[0] && !results[1])
+        std::rethrow_exception(failed);
+    }
+
+  if (!results[0]
+      || (results[1] && results[0]->num_states() > results[1]->num_states()))
+    return results[1];
+  return results[0];
+}
+
 void check_cout()
 {
   std::cout.flush();
@@ -144,6 +284,10 @@ int main(int argc, char* argv[])
     enum complement_t { NoComplement = 0, NCSBBest, NCSBSpot, NCSBPLDI };
     complement_t complement = NoComplement;
     output_type desired_output = TGBA;
+    std::string cache_dir;
+    unsigned long cache_size = 0;
+    unsigned workers = 1;
+    std::string included_in_file;
 
     auto match_opt =
       [&](const std::string& arg, const std::string& opt)
@@ -195,11 +339,67 @@ int main(int argc, char* argv[])
                  || match_opt(arg, "--skip-levels")
                  || match_opt(arg, "--scc-aware")
                  || match_opt(arg, "--powerset-on-cut")
+                 || match_opt(arg, "--simulation-pruning")
                  || match_opt(arg, "--preprocess")
                  || match_opt(arg, "--postprocess")
                  || match_opt(arg, "--postprocess-comp"))
           {
           }
+        else if (match_opt(arg, "--threads=")
+                 || match_opt(arg, "--scc-decompose")
+                 || match_opt(arg, "--parallel-jobs"))
+          {
+          }
+        else if (match_opt(arg, "--max-states=")
+                 || match_opt(arg, "--max-memory=")
+                 || match_opt(arg, "--time-limit=")
+                 || match_opt(arg, "--cutoff-factor=")
+                 || match_opt(arg, "--predict-jobs"))
+          {
+          }
+        else if (arg == "-j" || arg == "--jobs"
+                 || arg.compare(0, 7, "--jobs=") == 0)
+          {
+            const char* n;
+            if (arg[1] == 'j' || arg.size() == 6)
+              {
+                if (i + 1 >= argc)
+                  {
+                    std::cerr << "seminator: Option " << arg
+                              << " requires an argument.\n";
+                    return 2;
+                  }
+                n = argv[++i];
+              }
+            else
+              {
+                n = arg.c_str() + 7;
+              }
+            char* end;
+            workers = strtoul(n, &end, 10);
+            if (end == n || *end)
+              {
+                std::cerr << "seminator: invalid number of jobs " << n
+                          << '\n';
+                return 2;
+              }
+            if (workers == 0)
+              workers = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+          }
+        else if (arg.compare(0, 14, "--included-in=") == 0)
+          included_in_file = arg.substr(14);
+        else if (arg.compare(0, 12, "--cache-dir=") == 0)
+          cache_dir = arg.substr(12);
+        else if (arg.compare(0, 13, "--cache-size=") == 0)
+          {
+            char* end;
+            cache_size = strtoul(arg.c_str() + 13, &end, 10);
+            if (end == arg.c_str() + 13 || *end)
+              {
+                std::cerr << "seminator: invalid size in " << arg << '\n';
+                return 2;
+              }
+          }
         else if (arg == "--scc0")
           om.set("scc-aware", false);
         else if (arg == "--no-scc-aware")
@@ -322,13 +522,225 @@ int main(int argc, char* argv[])
           << "seminator --highlight and --complement are incompatible\n";
         return 1;
       }
+    if (!included_in_file.empty() && (high || complement || cd_check))
+      {
+        std::cerr << "seminator --included-in is incompatible with "
+          "--highlight, --complement, and --is-cd\n";
+        return 1;
+      }
 
     if (jobs == 0)
       jobs = AllJobs;
 
     om.set("output", complement ? TBA : desired_output);
 
+    if (!cache_dir.empty())
+      try
+        {
+          set_result_cache(cache_dir, cache_size);
+        }
+      catch (const std::runtime_error& e)
+        {
+          std::cerr << "seminator: " << e.what() << '\n';
+          return 2;
+        }
+    result_cache* cache = get_result_cache();
+
     auto dict = spot::make_bdd_dict();
+    int exit_code = 0;
+
+    spot::twa_graph_ptr included_in = nullptr;
+    if (!included_in_file.empty())
+      {
+        spot::automaton_stream_parser parser(included_in_file);
+        spot::parsed_aut_ptr parsed_aut = parser.parse(dict);
+        if (parsed_aut->format_errors(std::cerr))
+          return 2;
+        included_in = parsed_aut->aut;
+        if (!included_in || !included_in->acc().is_generalized_buchi())
+          {
+            std::cerr << "seminator: " << included_in_file
+                      << (included_in ? " does not contain a TGBA.\n"
+                                      : " does not contain an automaton.\n");
+            return 2;
+          }
+      }
+
+    // Runs the transformation on `aut`, the automaton read in
+    // `parsed_aut`, and returns the text to output for it (nothing if it
+    // is skipped). Throws budget_exceeded if all jobs were abandoned.
+    auto process = [&](spot::twa_graph_ptr aut,
+                       const spot::parsed_aut_ptr& parsed_aut) -> std::string
+      {
+        if (included_in)
+          {
+            auto word = inclusion_counterexample(aut, included_in, &om);
+            if (!word)
+              return "included\n";
+            std::ostringstream out;
+            out << "counterexample: " << *word << '\n';
+            return out.str();
+          }
+        if (cd_check)
+          {
+            if (!is_cut_deterministic(aut))
+              return {};
+          }
+        else
+          {
+            aut = semi_determinize(aut, cut_det, jobs, &om);
+            if (auto old_n = parsed_aut->aut->get_named_prop<std::string>
+                ("automaton-name"))
+              {
+                auto name =
+                  new std::string(((aut->num_sets() == 1)
+                                   ? "sDBA for " : "sDGBA for ") + *old_n);
+                if (cut_det)
+                  (*name)[0] = 'c';
+                aut->set_named_prop("automaton-name", name);
+              }
+
+            std::string comp_key;
+            spot::twa_graph_ptr comp = nullptr;
+            if (complement && cache)
+              {
+                comp_key = result_cache::key
+                  (aut, "complement=" + std::to_string(complement)
+                   + " output=" + std::to_string(desired_output)
+                   + " postprocess-comp="
+                   + std::to_string(om.get("postprocess-comp", 1))
+                   + " cutoff-factor="
+                   + std::to_string(om.get("cutoff-factor", 0)));
+                comp = cache->lookup(comp_key, dict);
+              }
+            if (comp)
+              aut = comp;
+            else if (complement)
+              {
+                spot::postprocessor postprocessor;
+                // We don't deal with TBA: (1) complement_semidet() returns a
+                // TBA, and (2) in Spot 2.8 spot::postprocessor only knows
+                // about state-based BA and Transition-based GBA.  So TBA/TGBA
+                // are simply simplified as TGBA.
+                postprocessor.set_type(desired_output == BA
+                                       ? spot::postprocessor::BA
+                                       : spot::postprocessor::TGBA);
+                if (!om.get("postprocess-comp", 1))
+                  {
+                    // Disable simplifications except acceptance change.
+                    postprocessor.set_level(spot::postprocessor::Low);
+                    postprocessor.set_pref(spot::postprocessor::Any);
+                  }
+
+                unsigned threads = std::max(0, om.get("threads", 1));
+                if (complement == NCSBBest)
+                  comp = complement_best(aut, postprocessor, threads,
+                                         om.get("cutoff-factor", 0));
+                else if (complement == NCSBSpot)
+                  comp = postprocessor.run(spot::complement_semidet(aut));
+                else
+                  comp = postprocessor.run
+                    (from_spot::complement_semidet(aut, false, threads));
+                if (cache)
+                  cache->store(comp_key, comp);
+                aut = comp;
+              }
+          }
+        const char* opts = nullptr;
+        if (high)
+          {
+            highlight_components(aut);
+            opts = "1.1";
+          }
+        std::ostringstream out;
+        spot::print_hoa(out, aut, opts) << '\n';
+        return out.str();
+      };
+
+    auto report = [&](const spot::parsed_aut_ptr& parsed_aut,
+                      const std::string& what)
+      {
+        if (parsed_aut->filename != "-")
+          std::cerr << parsed_aut->filename << ':';
+        std::cerr << parsed_aut->loc << ": seminator: " << what << '\n';
+        exit_code = 1;
+      };
+
+    // With --jobs, the automata are processed by child processes, at most
+    // `workers` at a time, while the next ones are parsed. Their results
+    // are printed in the order of the input: `pending` holds the automata
+    // being processed, or processed but waiting for the previous ones.
+    struct pending_aut
+    {
+      spot::parsed_aut_ptr parsed_aut;
+      std::unique_ptr<child_process> child;
+    };
+    std::deque<pending_aut> pending;
+
+    // Prints the results at the front of `pending` that are finished,
+    // or all of them if `all`. A child that fails (crashes, is killed, or
+    // throws) is reported like an automaton that exceeds the budget.
+    auto flush_pending = [&](bool all)
+      {
+        while (!pending.empty()
+               && (all || !pending.front().child->running()))
+          {
+            auto& front = pending.front();
+            try
+              {
+                std::string out = front.child->finish();
+                if (out[0] == 'E')
+                  report(front.parsed_aut, out.substr(1));
+                else
+                  std::cout << out.substr(1);
+              }
+            catch (const std::runtime_error& e)
+              {
+                report(front.parsed_aut, e.what());
+              }
+            pending.pop_front();
+          }
+      };
+
+    // Processes `parsed_aut` in a child process, or returns false if no
+    // child process can be created.
+    auto dispatch = [&](const spot::parsed_aut_ptr& parsed_aut)
+      {
+        for (;;)
+          {
+            flush_pending(false);
+            std::vector<child_process*> children;
+            unsigned running = 0;
+            for (auto& p: pending)
+              {
+                children.push_back(p.child.get());
+                running += p.child->running();
+              }
+            if (running < workers && pending.size() < 2 * workers)
+              break;
+            read_any(children);
+          }
+        try
+          {
+            std::unique_ptr<child_process> child(new child_process([&]()
+              {
+                try
+                  {
+                    return 'O' + process(parsed_aut->aut, parsed_aut);
+                  }
+                catch (const budget_exceeded& e)
+                  {
+                    return 'E' + std::string(e.what());
+                  }
+              }));
+            pending.push_back({parsed_aut, std::move(child)});
+          }
+        catch (const std::system_error&)
+          {
+            return false;
+          }
+        return true;
+      };
 
     for (std::string& path_to_file: path_to_files)
       {
@@ -339,7 +751,10 @@ int main(int argc, char* argv[])
             spot::parsed_aut_ptr parsed_aut = parser.parse(dict);
 
             if (parsed_aut->format_errors(std::cerr))
-              return 1;
+              {
+                flush_pending(true);
+                return 1;
+              }
 
             spot::twa_graph_ptr aut = parsed_aut->aut;
 
@@ -349,6 +764,7 @@ int main(int argc, char* argv[])
             // Check if input is TGBA
             if (!aut->acc().is_generalized_buchi())
               {
+                flush_pending(true);
                 if (parsed_aut->filename != "-")
                   std::cerr << parsed_aut->filename << ':';
                 std::cerr << parsed_aut->loc
@@ -356,71 +772,25 @@ int main(int argc, char* argv[])
                 return 1;
               }
 
-            if (cd_check)
-              {
-                if (!is_cut_deterministic(aut))
-                  continue;
-              }
-            else
+            if (workers > 1 && dispatch(parsed_aut))
+              continue;
+            // Sequential processing (also used when no child process
+            // can be created)
+            flush_pending(true);
+            try
               {
-                aut = semi_determinize(aut, cut_det, jobs, &om);
-                if (auto old_n = parsed_aut->aut->get_named_prop<std::string>
-                    ("automaton-name"))
-                  {
-                    auto name =
-                      new std::string(((aut->num_sets() == 1)
-                                       ? "sDBA for " : "sDGBA for ") + *old_n);
-                    if (cut_det)
-                      (*name)[0] = 'c';
-                    aut->set_named_prop("automaton-name", name);
-                  }
-
-                if (complement)
-                  {
-                    spot::twa_graph_ptr comp = nullptr;
-                    spot::postprocessor postprocessor;
-                    // We don't deal with TBA: (1) complement_semidet() returns a
-                    // TBA, and (2) in Spot 2.8 spot::postprocessor only knows
-                    // about state-based BA and Transition-based GBA.  So TBA/TGBA
-                    // are simply simplified as TGBA.
-                    postprocessor.set_type(desired_output == BA
-                                           ? spot::postprocessor::BA
-                                           : spot::postprocessor::TGBA);
-                    if (!om.get("postprocess-comp", 1))
-                      {
-                        // Disable simplifications except acceptance change.
-                        postprocessor.set_level(spot::postprocessor::Low);
-                        postprocessor.set_pref(spot::postprocessor::Any);
-                      }
-
-                    if (complement == NCSBSpot || complement == NCSBBest)
-                      {
-                        comp = spot::complement_semidet(aut);
-                        comp = postprocessor.run(comp);
-                      }
-                    if (complement == NCSBPLDI || complement == NCSBBest)
-                      {
-                        spot::twa_graph_ptr comp2 =
-                          from_spot::complement_semidet(aut);
-                        comp2 = postprocessor.run(comp2);
-                        if (!comp || comp->num_states() > comp2->num_states())
-                          comp = comp2;
-                      }
-                    aut = comp;
-                  }
+                std::cout << process(aut, parsed_aut);
               }
-            const char* opts = nullptr;
-            if (high)
+            catch (const budget_exceeded& e)
               {
-                highlight_components(aut);
-                opts = "1.1";
+                report(parsed_aut, e.what());
               }
-            spot::print_hoa(std::cout, aut, opts) << '\n';
           }
       }
+    flush_pending(true);
 
     check_cout();
-    return 0;
+    return exit_code;
 }
 
 
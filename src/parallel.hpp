@@ -0,0 +1,155 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that process batches of independent items.
+//
+// run(n, f) calls f(i, t) for every item i in [0, n), where t < size() is
+// the index of the calling thread; it can be used to select per-thread
+// scratch space. Items are claimed in small chunks from a shared counter,
+// so threads that finish early take over the remaining work. The calling
+// thread takes part in the work as thread 0 and run() returns once all
+// items are processed.
+//
+// The order in which items are processed is unspecified: f must only
+// write to data owned by item i or by thread t. An exception thrown by f
+// is rethrown by run() after the batch is finished.
+class worker_pool
+{
+public:
+  explicit worker_pool(unsigned threads)
+  {
+    if (threads == 0)
+      threads = 1;
+    for (unsigned t = 1; t < threads; ++t)
+      workers_.emplace_back([this, t]() { work(t); });
+  }
+
+  ~worker_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& w: workers_)
+      w.join();
+  }
+
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+
+  unsigned size() const
+  {
+    return workers_.size() + 1;
+  }
+
+  void run(size_t n, const std::function<void(size_t, unsigned)>& f)
+  {
+    if (workers_.empty() || n < 2)
+      {
+        for (size_t i = 0; i < n; ++i)
+          f(i, 0);
+        return;
+      }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &f;
+      items_ = n;
+      next_.store(0);
+      busy_ = workers_.size();
+      error_ = nullptr;
+      ++round_;
+    }
+    start_.notify_all();
+    process(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return busy_ == 0; });
+    job_ = nullptr;
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+private:
+  void work(unsigned t)
+  {
+    unsigned seen = 0;
+    for (;;)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          start_.wait(lock, [&]() { return stop_ || round_ != seen; });
+          if (stop_)
+            return;
+          seen = round_;
+        }
+        process(t);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0)
+          done_.notify_one();
+      }
+  }
+
+  void process(unsigned t)
+  {
+    const size_t chunk = 16;
+    for (;;)
+      {
+        size_t begin = next_.fetch_add(chunk);
+        if (begin >= items_)
+          return;
+        size_t end = std::min(begin + chunk, items_);
+        try
+          {
+            for (size_t i = begin; i < end; ++i)
+              (*job_)(i, t);
+          }
+        catch (...)
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+              error_ = std::current_exception();
+            // Let the other threads run out of items
+            next_.store(items_);
+            return;
+          }
+      }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  bool stop_ = false;
+  unsigned round_ = 0;
+  unsigned busy_ = 0;
+  const std::function<void(size_t, unsigned)>* job_ = nullptr;
+  size_t items_ = 0;
+  std::atomic<size_t> next_{0};
+  std::exception_ptr error_;
+};
@@ -18,15 +18,17 @@
 
 #include <powerset.hpp>
 
-std::string powerset_name(state_set * ps)
+#include <algorithm>
+
+std::string powerset_name(const state_set_table& sets, set_id ps)
 {
-  if (ps->size() == 0)
+  if (ps == state_set_table::empty_id)
     return "∅";
 
   std::stringstream ss;
   ss << "{";
-  for (auto state: *ps)
-    ss << state << ',';
+  for (auto it = sets.begin(ps); it != sets.end(ps); ++it)
+    ss << *it << ',';
   //Remove the last comma
   ss.seekp(-1,ss.cur);
   ss << "}";
@@ -34,24 +36,223 @@ std::string powerset_name(state_set * ps)
   return ss.str();
 }
 
-spot::bitvect_array *
-powerset_builder::compute_bva(state_t s, unsigned mark) {
-  //create bitvect_array of `nc` bitvectors with `ns` bits
-  auto bv = spot::make_bitvect_array(ns_, nc_);
+void
+powerset_builder::enumerate_minterms()
+{
+  if ((-1UL / ns_) >> nap_ == 0)
+    throw std::runtime_error("too many atomic propositions (or states)");
 
+  // Build a correspondence between conjunctions of APs and unsigned
+  // indexes.
+  num2bdd_.reserve(1UL << nap_);
+  bdd all = bddtrue;
   bdd allap = src_->ap_vars();
-  for (auto& t: src_->out(s))
-  {
-    if ((!t.acc.has(mark)) && mark < src_->num_sets())
-      continue;
-    bdd all = t.cond;
-    while (all != bddfalse)
+  while (all != bddfalse)
     {
       bdd one = bdd_satoneset(all, allap, bddfalse);
       all -= one;
-      unsigned num = bdd2num_[one];
-      bv->at(num).set(t.dst);
+      bdd2num_.emplace(one, num2bdd_.size());
+      num2bdd_.emplace_back(one);
+      if (budget_ && (num2bdd_.size() & 1023) == 0)
+        {
+          budget_->check_memory(memory_usage());
+          budget_->check_time();
+        }
+    }
+  assert(num2bdd_.size() == (1UL << nap_));
+}
+
+void
+powerset_builder::compute_letter_classes()
+{
+  // Refine {⊤} by each distinct label
+  std::vector<bdd> classes{bddtrue};
+  std::set<int> seen;
+  for (auto& e: src_->edges())
+    {
+      if (!seen.insert(e.cond.id()).second)
+        continue;
+      if (budget_)
+        {
+          budget_->check_memory(classes.capacity() * sizeof(bdd));
+          budget_->check_time();
+        }
+      unsigned n = classes.size();
+      for (unsigned i = 0; i < n; ++i)
+        {
+          bdd in = classes[i] & e.cond;
+          if (in == bddfalse || in == classes[i])
+            continue;
+          classes.emplace_back(classes[i] - e.cond);
+          classes[i] = in;
+        }
+    }
+
+  // Order the classes by their smallest minterm. bdd_satoneset() with
+  // negative polarity returns the smallest minterm of a class in the
+  // lexicographic order of the variables (negative first), which is
+  // also the order in which enumerate_minterms() lists them.
+  bdd allap = src_->ap_vars();
+  std::vector<std::pair<std::vector<bool>, unsigned>> keys;
+  keys.reserve(classes.size());
+  for (unsigned i = 0; i < classes.size(); ++i)
+    {
+      std::vector<bool> key;
+      key.reserve(nap_);
+      bdd one = bdd_satoneset(classes[i], allap, bddfalse);
+      while (one != bddtrue)
+        {
+          bool neg = bdd_high(one) == bddfalse;
+          key.push_back(!neg);
+          one = neg ? bdd_low(one) : bdd_high(one);
+        }
+      keys.emplace_back(std::move(key), i);
+    }
+  std::sort(keys.begin(), keys.end());
+
+  num2bdd_.reserve(classes.size());
+  for (auto& k: keys)
+    num2bdd_.emplace_back(classes[k.second]);
+}
+
+const std::vector<unsigned>&
+powerset_builder::conds_of(const bdd& cond)
+{
+  auto it = cond2nums_.find(cond);
+  if (it != cond2nums_.end())
+    return it->second;
+
+  std::vector<unsigned> nums;
+  if (bdd2num_.empty())
+    {
+      for (unsigned c = 0; c < nc_; ++c)
+        if (bdd_implies(num2bdd_[c], cond))
+          nums.push_back(c);
+    }
+  else
+    {
+      bdd allap = src_->ap_vars();
+      bdd all = cond;
+      while (all != bddfalse)
+        {
+          bdd one = bdd_satoneset(all, allap, bddfalse);
+          all -= one;
+          nums.push_back(bdd2num_[one]);
+        }
+    }
+  return cond2nums_.emplace(cond, std::move(nums)).first->second;
+}
+
+void
+powerset_builder::build_successor_index()
+{
+  first_succ_.reserve(ns_ + 1);
+  succs_.reserve(src_->num_edges());
+  for (state_t s = 0; s < ns_; ++s)
+  {
+    if (budget_ && (s & 255) == 0)
+    {
+      budget_->check_memory(succs_.capacity() * sizeof(succ_entry));
+      budget_->check_time();
     }
+    size_t first = succs_.size();
+    first_succ_.push_back(first);
+    for (auto& t: src_->out(s))
+      for (unsigned num: conds_of(t.cond))
+        succs_.push_back({num, t.dst, t.acc});
+
+    // Sort by (condition, destination) and merge the entries of parallel
+    // edges
+    auto b = succs_.begin() + first;
+    std::sort(b, succs_.end(),
+              [](const succ_entry& l, const succ_entry& r)
+              {
+                return l.cond < r.cond
+                  || (l.cond == r.cond && l.dst < r.dst);
+              });
+    auto out = b;
+    for (auto in = b; in != succs_.end(); ++in)
+      if (out != b && (out - 1)->cond == in->cond && (out - 1)->dst == in->dst)
+        (out - 1)->acc |= in->acc;
+      else
+        *out++ = *in;
+    succs_.erase(out, succs_.end());
+  }
+  first_succ_.push_back(succs_.size());
+  succs_.shrink_to_fit();
+}
+
+size_t
+powerset_builder::memory_usage() const
+{
+  size_t res = sizeof(*this);
+  res += first_succ_.capacity() * sizeof(unsigned);
+  res += succs_.capacity() * sizeof(succ_entry);
+  res += num2bdd_.capacity() * sizeof(bdd);
+  for (auto& p: cond2nums_)
+    res += sizeof(p) + p.second.capacity() * sizeof(unsigned);
+  res += bdd2num_.size() * (sizeof(bdd) + sizeof(unsigned));
+  return res;
+}
+
+void
+powerset_builder::reset(succ_buffer& out) const
+{
+  size_t nw = state_words();
+  if (out.nw != nw || out.rows.size() != nc_ * nw)
+  {
+    out.nw = nw;
+    out.rows.assign(nc_ * nw, 0);
+    out.nonempty.assign(bits::words_for(nc_), 0);
+    return;
   }
-  return bv;
+  for (unsigned c = out.next(0); c < nc_; c = out.next(c + 1))
+    bits::fill_zero(out.row(c), nw);
+  bits::fill_zero(out.nonempty.data(), out.nonempty.size());
+}
+
+void
+powerset_builder::succs(set_id ss, unsigned mark, const bits::word* intersect,
+                        succ_buffer& out) const
+{
+  reset(out);
+  bool all_marks = mark >= src_->num_sets();
+
+  // Add the successors into outgoing bitsets. The intersection is applied
+  // in the same pass: successors outside of `intersect` are never set, so
+  // the rows need no masking afterwards and `nonempty` is exact.
+  for (auto it = sets_.begin(ss); it != sets_.end(ss); ++it)
+    for (auto e = succ_begin(*it); e != succ_end(*it); ++e)
+      if ((all_marks || e->acc.has(mark))
+          && (!intersect || bits::test(intersect, e->dst)))
+      {
+        bits::set(out.row(e->cond), e->dst);
+        bits::set(out.nonempty.data(), e->cond);
+      }
+}
+
+void
+powerset_builder::succs_by_mark(set_id ss, const bits::word* intersect,
+                                succ_buffer& all,
+                                std::vector<succ_buffer>& marked) const
+{
+  reset(all);
+  marked.resize(src_->num_sets());
+  for (auto& m: marked)
+    reset(m);
+
+  for (auto it = sets_.begin(ss); it != sets_.end(ss); ++it)
+    for (auto e = succ_begin(*it); e != succ_end(*it); ++e)
+      if (!intersect || bits::test(intersect, e->dst))
+      {
+        bits::set(all.row(e->cond), e->dst);
+        bits::set(all.nonempty.data(), e->cond);
+        if (!e->acc)
+          continue;
+        for (unsigned m: e->acc.sets())
+        {
+          bits::set(marked[m].row(e->cond), e->dst);
+          bits::set(marked[m].nonempty.data(), e->cond);
+        }
+      }
 }
@@ -19,196 +19,219 @@
 #pragma once
 
 #include <types.hpp>
+#include <bitops.hpp>
+#include <budget.hpp>
 #include <spot/misc/bddlt.hh>
 
 /**
-* Converts a collection of states into bitvector
+* Returns a string in the form `{s1, s2, s3}` where si is a reference to the input_aut
 */
-template <typename Iterator>
-static void ps_to_bv(spot::bitvect * bv,
-                     Iterator begin = Iterator(),
-                     Iterator end = Iterator()
-                     )
-{
-  for (auto i = begin; i != end; i++)
-    bv->set(*i);
-}
+std::string powerset_name(const state_set_table& sets, set_id ps);
 
-static state_set * bv_to_ps(const spot::bitvect* in)
+// Caller-owned storage for the successors computed by powerset_builder.
+//
+// It holds one bitset (row) of `nw` words for each condition, and a mask of
+// the conditions whose row is not empty. The buffer is sized on its first
+// use and then reused: powerset_builder::succs() only clears the rows that
+// were not empty, so computing successors does not allocate in steady state.
+struct succ_buffer
 {
-  auto ss = new state_set;
-  unsigned ns = in->size();
-  for (unsigned pos = 0; pos < ns; ++pos)
-    if (in->get(pos))
-      ss->insert(pos);
-  return ss;
-}
+  size_t nw = 0;                   // number of words per row
+  std::vector<bits::word> rows;    // row `c` starts at rows[c * nw]
+  std::vector<bits::word> nonempty;
 
+  bits::word* row(unsigned c)
+  {
+    return rows.data() + c * nw;
+  }
 
-/**
-* Returns a string in the form `{s1, s2, s3}` where si is a reference to the input_aut
-*/
-std::string powerset_name(state_set *);
+  const bits::word* row(unsigned c) const
+  {
+    return rows.data() + c * nw;
+  }
+
+  bool has(unsigned c) const
+  {
+    return bits::test(nonempty.data(), c);
+  }
+
+  // First non-empty condition >= c, or a value >= nc if there is none
+  unsigned next(unsigned c) const
+  {
+    return bits::find_next(nonempty.data(), nonempty.size(), c);
+  }
+};
 
 // Class that computes successors for powerset construction.
 //
-// The main function is get_succs(state_set ss, mark, intersect iterators) which
-// returns a vector `succ` of size `nc` of state_sets, where `nc` is the number
-// of possible combinations of atomic propositions. `succ[ci]` are successors of
-// ss under the `ci`-th combination of AP. The mapping to the condition can be
-// done using num2bdd_ vector. In powerset construction, there should be edge:
-// `ss --num2bdd_[ci]--> get_succs(ss)->at(ci)` for each `ci`.
+// The main function is succs(set_id ss, mark, intersect, out) which fills
+// `out` with `nc` rows, where `nc` is the number of conditions (see below).
+// The row `ci` are successors of ss under the `ci`-th condition. The mapping
+// to the condition can be done using num2bdd_ vector. In powerset
+// construction, there should be edge: `ss --num2bdd_[ci]--> out.row(ci)`
+// for each `ci` such that `out.has(ci)`.
+//
+// `ss` is a set interned in the state_set_table given to the constructor.
 //
 // The mark, if supplied, limits the successors using only transitions marked by
-// mark. If mark is higher than the highest mark (or not supplied), no
-// restriction is applied.
+// mark. If mark is higher than the highest mark, no restriction is applied.
 //
 // If intersect is supplied, the resulting successors are intersect with it.
 //
-// Uses bitvector arrays to store already computed successors of the states
-// from the input automaton.
+// The successors of the states of the input automaton are precomputed in a
+// sparse index (see succ_entry); bitsets are only used to accumulate the
+// union of the successors of a set.
+//
+// By default, the conditions are not all the 2^|AP| minterms, but the letter
+// classes: the coarsest partition of the alphabet such that each edge label
+// of `src` is a union of classes. All letters of a class lead to the same
+// successors from any set of states, so the cost of the construction depends
+// on the variety of the labels rather than on the number of AP. The classes
+// are ordered by their smallest minterm, so that states are discovered in the
+// same order as with minterms. Pass `letter_classes = false` to the
+// constructor to enumerate all minterms instead.
+//
+// The precomputations check `budget` (if given) for time and memory.
 class powerset_builder {
 public:
 
   typedef spot::bitvect_array bitvect_array;
-  typedef std::map<state_t, bitvect_array *> state_to_pwsucc_m;
-  typedef std::vector<state_to_pwsucc_m *> level2pwsucc_map;
 
-  powerset_builder(const_aut_ptr src) :
+  // One successor of a state of `src_`: `dst` is reachable under the
+  // condition `cond` by some edges whose marks are (together) `acc`.
+  struct succ_entry
+  {
+    unsigned cond;
+    state_t dst;
+    acc_mark acc;
+  };
+
+  powerset_builder(const_aut_ptr src, state_set_table& sets,
+                   bool letter_classes = true,
+                   const resource_budget* budget = nullptr) :
   src_(src),
+  sets_(sets),
   ns_(src_->num_states()),
-  nap_(src_->ap().size())
+  nap_(src_->ap().size()),
+  budget_(budget)
   {
-    if ((-1UL / ns_) >> nap_ == 0)
-      throw std::runtime_error("too many atomic propositions (or states)");
-
-    // Build a correspondence between conjunctions of APs and unsigned
-    // indexes. Fills num2bdd_ and bdd2num_
-    num2bdd_.reserve(1UL << nap_);
-    bdd all = bddtrue;
-    bdd allap = src_->ap_vars();
-    while (all != bddfalse)
-      {
-        bdd one = bdd_satoneset(all, allap, bddfalse);
-        all -= one;
-        bdd2num_.emplace(one, num2bdd_.size());
-        num2bdd_.emplace_back(one);
-      }
+    // Fills num2bdd_ (and bdd2num_ for minterms)
+    if (letter_classes)
+      compute_letter_classes();
+    else
+      enumerate_minterms();
 
     nc_ = num2bdd_.size();        // number of conditions
-    assert(nc_ == (1UL << nap_));
-
-    // Initialize the maps for each level
-    for (unsigned l = 0; l <= src_->num_sets(); ++l)
-      pw_storage.emplace_back(new state_to_pwsucc_m());
-  }
 
-  ~powerset_builder()
-  {
-    for (auto map : pw_storage) {
-      for (auto s : (*map)) {
-        auto bva = s.second;
-        delete bva;
-      }
-      delete map;
-    }
+    build_successor_index();
   }
 
   size_t nc_; // Number of conditions
   std::vector<bdd> num2bdd_;
+  // Only filled when the conditions are minterms
   std::map<bdd, unsigned, spot::bdd_less_than> bdd2num_;
 
-  // Returns successors of the input state_set under given mark. If the mark
+  // Returns the indices of the conditions included in `cond`. The `cond`
+  // must be a label of some edge of `src_` (or a union of conditions).
+  const std::vector<unsigned>& conds_of(const bdd& cond);
+
+  // The successors of `s` in `src_`, sorted by condition and destination
+  const succ_entry* succ_begin(state_t s) const
+  {
+    return succs_.data() + first_succ_[s];
+  }
+
+  const succ_entry* succ_end(state_t s) const
+  {
+    return succs_.data() + first_succ_[s + 1];
+  }
+
+  // Approximate number of bytes used by the builder
+  size_t memory_usage() const;
+
+  // Number of states of `src_`
+  unsigned num_states() const
+  {
+    return ns_;
+  }
+
+  // Number of words of a bitset over the states of `src_`
+  size_t state_words() const
+  {
+    return bits::words_for(ns_);
+  }
+
+  // Bitset over the states of `src_` containing the states in [begin, end)
+  template <class Iterator>
+  std::vector<bits::word> state_mask(Iterator begin, Iterator end) const
+  {
+    return bits::from_range(ns_, begin, end);
+  }
+
+  // Computes the successors of `ss` under given mark into `out`. If the mark
   // is >= src_->num_sets(), no restriction happens. Intersect successors with
-  // `intersect` if supplied.
+  // the bitset `intersect` (of state_words() words) if it is not nullptr.
   //
-  // Returns:
-  // 0: successors of state_set under num2bdd_[0]-transtions marked by mark
-  // 1: successors of state_set under num2bdd_[1]-transtions marked by mark
+  // Fills:
+  // out.row(0): successors of ss under num2bdd_[0]-transtions marked by mark
+  // out.row(1): successors of ss under num2bdd_[1]-transtions marked by mark
   //   ...  ...  ... ... ... ... ... ... ... ...
-  // nc_-1: successors of state_set under num2bdd_[nc-1]-transtions marked by mark
+  // out.row(nc_-1): successors of ss under num2bdd_[nc-1]-transtions marked by mark
   //
-  template <class Iterator = ss_it>
-  succ_vect * get_succs(state_set * ss, unsigned mark,
-                        Iterator begin = empty_set.begin(),
-                        Iterator end = empty_set.end(),
-                        bool complement_iters = false)
-  {
-    if (*ss == empty_set)
-      return new succ_vect(nc_, empty_set);
-
-    auto sm = pw_storage.at(mark);
-
-    auto i_bv = spot::make_bitvect(ns_);
-    if (begin != end)
-    {
-      ps_to_bv(i_bv, begin, end);
-      if (complement_iters)
-        i_bv->flip_all();
-    }
-    else
-      i_bv->set_all();
-
-    // outgoing map
-    auto om = std::unique_ptr<bitvect_array>(spot::make_bitvect_array(ns_, nc_));
-    auto result = new succ_vect;
-
-    for (auto s : *ss)
-    {
-      if (sm->count(s) == 0)
-      { // Compute the bitvector_array with powerset transitions
-        auto bva = compute_bva(s, mark);
-        (*sm)[s] = bva;
-      }
-      // Add the successors into outgoing bitvector
-      for (unsigned c = 0; c < nc_; ++c)
-        (om->at(c) |= sm->at(s)->at(c)) &= *i_bv;
-    }
-    // Convert bitvector for each condition into a set
-    for (unsigned c = 0; c < nc_; ++c)
-    {
-      auto ps = bv_to_ps(&om->at(c));
-      result->emplace_back(std::move(*ps));
-      delete ps;
-    }
-    delete i_bv;
-
-    return result;
-  }
+  // and sets out.has(c) iff out.row(c) is not empty.
+  void succs(set_id ss, unsigned mark, const bits::word* intersect,
+             succ_buffer& out) const;
 
   // By default do not restrict to marks == use h+1
-  template <class Iterator = ss_it>
-  succ_vect * get_succs(state_set * ss,
-                        Iterator begin = empty_set.begin(),
-                        Iterator end = empty_set.end(),
-                        bool complement_iters = false) {
-    return get_succs<Iterator>(ss, src_->num_sets(), begin, end, complement_iters);
+  void succs(set_id ss, const bits::word* intersect, succ_buffer& out) const
+  {
+    succs(ss, src_->num_sets(), intersect, out);
   }
 
+  // Computes in one pass over the successors of `ss` both the unrestricted
+  // successors (into `all`, as succs() without mark) and the successors
+  // under each mark m < src_->num_sets() (into `marked[m]`). Breakpoint
+  // states need the successors for several levels of the same set; this
+  // reads the sparse index only once for all of them.
+  void succs_by_mark(set_id ss, const bits::word* intersect,
+                     succ_buffer& all,
+                     std::vector<succ_buffer>& marked) const;
+
+  // Prepares `out` for a new computation: sizes it for this builder on first
+  // use and clears the rows that are not empty.
+  void reset(succ_buffer& out) const;
+
 private:
   const_aut_ptr src_; // input automaton
+  state_set_table& sets_; // storage of the sets of states
   unsigned ns_;       // number of states of input automaton
   unsigned nap_;      // number of atomic propositions
-
-  // The storage for precomputed powerset successors of states of `src_`.
-  // We have a vector of size src_->num_of_acc_sets()+1 = `h+2`.
-  // For each mark we constrain the successors on those under the given mark.
-  // The level `h` is not contrained by any mark.
-  //
-  // The keys are:
-  //   level - state - condition -> bitvector
+  const resource_budget* budget_; // may be nullptr
+
+  // The storage for precomputed successors of states of `src_` in the
+  // compressed sparse row format: the successors of `s` are
+  //   succs_[first_succ_[s]] ... succs_[first_succ_[s+1] - 1]
+  // sorted by condition and destination. Each entry keeps the marks of the
+  // edges, so all levels are served by the same index: for level `l` a
+  // l-successor `t` of `s` is a state such that we have a transition marked
+  // by `l` from `s` to `t`.
   //
-  // For level `l` a l-successor `t` of `s` is a state such that we have a
-  // transition marked by `l` from `s` to `t`. For each level, we have a map
-  // from states to bitvetor_array. Each bitvect_array looks like this (for 2 AP):
-  //   0 ( a &  b) | <bitvector representing l-successors from `s` under  a &  b>
-  //   1 (!a &  b) | <bitvector representing l-successors from `s` under !a &  b>
-  //   2 ( a & !b) | <bitvector representing l-successors from `s` under  a & !b>
-  //   3 (!a & !b) | <bitvector representing l-successors from `s` under !a & !b>
-  level2pwsucc_map pw_storage;
-
-  /**
-  * Compute bitvector_array for `s` and `mark`
-  */
-  bitvect_array * compute_bva(state_t, unsigned mark);
+  // The index takes space linear in the number of pairs (edge, condition of
+  // the edge), while a dense representation needs ns × nc bits per state and
+  // level.
+  std::vector<unsigned> first_succ_;
+  std::vector<succ_entry> succs_;
+
+  // Cache for conds_of()
+  std::map<bdd, std::vector<unsigned>, spot::bdd_less_than> cond2nums_;
+
+  // Build num2bdd_ as the partition of the alphabet induced by the edge
+  // labels of `src_`
+  void compute_letter_classes();
+
+  // Build num2bdd_ and bdd2num_ as all the minterms over the AP of `src_`
+  void enumerate_minterms();
+
+  // Fill first_succ_ and succs_ in one pass over the edges of `src_`
+  void build_successor_index();
 };
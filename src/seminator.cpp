@@ -21,15 +21,25 @@
 #include <cutdet.hpp>
 #include <bscc.hpp>
 #include <breakpoint_twa.hpp>
+#include <subprocess.hpp>
+#include <cache.hpp>
 
 #include <spot/twaalgos/degen.hh>
 #include <spot/twaalgos/isdet.hh>
+#include <spot/twaalgos/isomorph.hh>
 #include <spot/twaalgos/sccinfo.hh>
 #include <spot/twaalgos/minimize.hh>
 #include <spot/misc/optionmap.hh>
 #include <spot/twaalgos/sccfilter.hh>
 #include <spot/twa/bddprint.hh>
 
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <system_error>
+
 /**
  * Class running possible multiple types of the transformation
  * and returns the best result. It also handles pre- and post-
@@ -47,13 +57,17 @@ public:
   */
   seminator(spot::twa_graph_ptr input, bool cut_det,
             const spot::option_map* opt = nullptr)
-    : input_(spot::scc_filter(input, true)), opt_(opt), cut_det_(cut_det)
+    : input_(spot::scc_filter(input, true)), opt_(opt), cut_det_(cut_det),
+      budget_(opt)
   {
     if (!opt)
       opt_ = new const spot::option_map;
 
     preproc_  = opt_->get("preprocess",0);
     postproc_ = opt_->get("postprocess", 1);
+    parallel_ = opt_->get("parallel-jobs", 0);
+    cutoff_   = opt_->get("cutoff-factor", 0);
+    predict_  = opt_->get("predict-jobs", 0);
 
     if (preproc_)
       preprocessor_.set_pref(spot::postprocessor::Deterministic);
@@ -77,6 +91,27 @@ public:
   /**
   * Run the algorithm for all jobs and returns the smallest automaton
   *
+  * A job that exceeds the resource budget (or whose child process fails,
+  * with parallel-jobs) is abandoned. The smallest result of the other jobs
+  * is returned, and the error of the first abandoned job is rethrown if no
+  * job finished.
+  *
+  * With the parallel-jobs option, the jobs run concurrently in child
+  * processes (see run_parallel()). The result is the same.
+  *
+  * With the cutoff-factor option K > 0, a job is abandoned before its
+  * postprocessing if its automaton has more than K times as many states
+  * as the best result found so far (by the previous jobs, or by the other
+  * children in parallel). The returned automaton may then be larger than
+  * the one the abandoned job would have produced after postprocessing.
+  *
+  * The inputs of all jobs are prepared first, and a job whose input is
+  * isomorphic to the input of an earlier job is skipped, as it would
+  * build the same automaton.
+  *
+  * With the predict-jobs option K > 0, only the K jobs with the smallest
+  * predicted result are run (see predict_size()).
+  *
   * @param[in] jobs may specify more jobs, 0 (default) means AllJobs.
   */
   spot::twa_graph_ptr run(jobs_type jobs)
@@ -95,53 +130,349 @@ public:
           jobs &= ~ViaTBA;
       }
 
-    spot::twa_graph_ptr best = nullptr;
+    std::vector<jobs_type> todo;
     for (auto job : {ViaTGBA, ViaTBA, ViaSBA})
       if (job & jobs)
-        {
-          auto result = postprocess_job(process_job(prepare_input(job)));
-          if (!best || (best->num_states() > result->num_states()))
-            best = result;
-        }
+        todo.push_back(job);
+
+    std::vector<spot::twa_graph_ptr> inputs(todo.size());
+    if (todo.size() > 1)
+      drop_duplicate_jobs(todo, inputs);
+    if (predict_ > 0 && todo.size() > unsigned(predict_))
+      select_predicted(todo, inputs);
+
+    std::vector<spot::twa_graph_ptr> results(todo.size());
+    std::exception_ptr exceeded = nullptr;
+    shared_minimum best_size;
+    bool in_parallel = parallel_ && todo.size() > 1
+      && run_parallel(todo, inputs, best_size, results, exceeded);
+    if (!in_parallel)
+      for (unsigned i = 0; i < todo.size(); ++i)
+        try
+          {
+            results[i] = run_job(todo[i], inputs[i], best_size);
+          }
+        catch (const budget_exceeded&)
+          {
+            if (!exceeded)
+              exceeded = std::current_exception();
+          }
+
+    spot::twa_graph_ptr best = nullptr;
+    for (auto& result: results)
+      if (result && (!best || (best->num_states() > result->num_states())))
+        best = result;
+    if (!best && exceeded)
+      std::rethrow_exception(exceeded);
+    // In parallel, the jobs that are cut off depend on the timing
+    reproducible_ = !exceeded
+      && (!in_parallel || std::all_of(results.begin(), results.end(),
+                                      [](const spot::twa_graph_ptr& r)
+                                      {
+                                        return r != nullptr;
+                                      }));
     return best;
   }
 
+  // Whether the result of the last run() depends neither on the resource
+  // budget nor on the timing of the parallel jobs
+  bool reproducible() const
+  {
+    return reproducible_;
+  }
+
 private:
 
-  spot::twa_graph_ptr prepare_input(jobs_type job)
+  // Returns nullptr if the job is cut off (see run()). Otherwise lowers
+  // best_size to the size of the result. `input` is the result of
+  // prepare_input(job) if it is already known, or nullptr.
+  spot::twa_graph_ptr run_job(jobs_type job, spot::twa_graph_ptr input,
+                              shared_minimum& best_size)
   {
-    switch (job)
+    budget_.check_time();
+    if (!input)
+      input = prepare_input(job);
+    budget_.check_time();
+    auto result = process_job(input);
+    budget_.check_time();
+    unsigned best = best_size.get();
+    if (cutoff_ > 0 && best != -1U
+        && result->num_states() > uint64_t(cutoff_) * best)
+      return nullptr;
+    result = postprocess_job(result);
+    best_size.update(result->num_states());
+    return result;
+  }
+
+  // Runs each job in a child process, and reads its result in the HOA
+  // format (or the budget_exceeded error that stopped it). A job whose
+  // child fails is abandoned, and its error is kept in `exceeded` like a
+  // budget_exceeded error. BuDDy cannot be used from several threads, but
+  // the children have their own copy of it. The latency is then that of
+  // the slowest job.
+  //
+  // Returns false if the child processes cannot be created; the jobs
+  // should then be run sequentially.
+  bool run_parallel(const std::vector<jobs_type>& todo,
+                    const std::vector<spot::twa_graph_ptr>& inputs,
+                    shared_minimum& best_size,
+                    std::vector<spot::twa_graph_ptr>& results,
+                    std::exception_ptr& exceeded)
+  {
+    std::vector<std::unique_ptr<child_process>> children;
+    try
       {
-      case ViaTGBA:
-        if (!preproc_)
+        for (unsigned i = 0; i < todo.size(); ++i)
+          children.emplace_back(new child_process([&, i]()
+            {
+              try
+                {
+                  auto res = run_job(todo[i], inputs[i], best_size);
+                  return res ? 'A' + automaton_to_string(res) : "C";
+                }
+              catch (const budget_exceeded& e)
+                {
+                  return "B " + std::to_string(e.resource())
+                    + ' ' + std::to_string(e.limit())
+                    + ' ' + std::to_string(e.used());
+                }
+            }));
+      }
+    catch (const std::system_error&)
+      {
+        return false;
+      }
+
+    std::vector<child_process*> running;
+    for (auto& c: children)
+      running.push_back(c.get());
+    read_all(running);
+
+    for (unsigned i = 0; i < todo.size(); ++i)
+      {
+        std::string out;
+        try
           {
-            return input_;
+            out = children[i]->finish();
+            if (out[0] == 'A')
+              {
+                results[i] = automaton_from_string(out.substr(1),
+                                                   input_->get_dict());
+                continue;
+              }
           }
-        preprocessor_.set_type(spot::postprocessor::TGBA);
-        return preprocessor_.run(input_);
-      case ViaTBA:
-        {
-          auto out = spot::degeneralize_tba(input_);
-          if (preproc_)
-            {
-              preprocessor_.set_type(spot::postprocessor::TGBA);
-              out = preprocessor_.run(out);
-            }
-          return out;
-        }
-      case ViaSBA:
-        if (!preproc_)
+        catch (const std::runtime_error&)
           {
-            return spot::degeneralize(input_);
+            // The child failed (it crashed, was killed, or threw): its job
+            // is abandoned as if it exceeded the budget.
+            if (!exceeded)
+              exceeded = std::current_exception();
+            continue;
           }
-        else
+        if (out[0] == 'C')        // cut off
+          continue;
+        std::istringstream in(out.substr(1));
+        int resource;
+        size_t limit, used;
+        in >> resource >> limit >> used;
+        if (!exceeded)
+          exceeded = std::make_exception_ptr
+            (budget_exceeded(static_cast<budget_exceeded::resource_t>
+                             (resource), limit, used));
+      }
+    return true;
+  }
+
+  // Whether `a` and `b` are the same automaton up to the numbering of
+  // their states
+  static bool same_automaton(const spot::const_twa_graph_ptr& a,
+                             const spot::const_twa_graph_ptr& b)
+  {
+    if (a == b)
+      return true;
+    if (a->num_states() != b->num_states()
+        || a->num_edges() != b->num_edges()
+        || !(a->acc() == b->acc())
+        || bool(a->prop_state_acc()) != bool(b->prop_state_acc()))
+      return false;
+    return spot::isomorphism_checker::are_isomorphic(a, b);
+  }
+
+  // Prepares the inputs of the jobs of `todo` (into `inputs`), and removes
+  // the jobs whose input is the same as the input of an earlier job.
+  void drop_duplicate_jobs(std::vector<jobs_type>& todo,
+                           std::vector<spot::twa_graph_ptr>& inputs)
+  {
+    std::vector<jobs_type> kept_jobs;
+    std::vector<spot::twa_graph_ptr> kept_inputs;
+    for (auto job: todo)
+      {
+        budget_.check_time();
+        auto input = prepare_input(job);
+        if (std::none_of(kept_inputs.begin(), kept_inputs.end(),
+                         [&](const spot::twa_graph_ptr& kept)
+                         {
+                           return same_automaton(kept, input);
+                         }))
           {
-            preprocessor_.set_type(spot::postprocessor::BA);
-            return preprocessor_.run(input_);
+            kept_jobs.push_back(job);
+            kept_inputs.push_back(input);
           }
+      }
+    todo.swap(kept_jobs);
+    inputs.swap(kept_inputs);
+  }
+
+  // Estimation of the size of the automaton built by process_job(input)
+  struct prediction
+  {
+    bool exact;         // the sample covered the whole automaton
+    uint64_t size;      // its size if exact, a score otherwise
+  };
+
+  // Number of states of the construction sampled by predict_size()
+  static constexpr unsigned sample_states = 1024;
+
+  // Predicts the size of the result of process_job(input) from cheap
+  // features of the input. An input that process_job() returns as it is
+  // has a known size. Otherwise the construction of process_job() (the
+  // determinization of the first component of a semi-deterministic input,
+  // or the breakpoint construction) is run until it has sample_states
+  // states; if it ends before, its size is known. If not, the score is
+  // the number of states in accepting SCCs (which are the ones copied to
+  // the 2nd component), times the number of levels of the breakpoint
+  // construction (one per acceptance set), times one more than the number
+  // of nondeterministic states. Exact predictions are ranked before the
+  // scores.
+  prediction predict_size(const spot::twa_graph_ptr& input) const
+  {
+    state_set non_det_states;
+    bool semi_det = spot::is_semi_deterministic(input);
+    if (spot::is_deterministic(input) ||
+        is_cut_deterministic(input, &non_det_states) ||
+        (semi_det && !cut_det_))
+      return {true, input->num_states()};
+
+    // The sample also stays within the time and memory limits of the user
+    resource_budget sample_budget = budget_.with_max_states(sample_states);
+    try
+      {
+        if (semi_det)
+          return {true, determinize_first_component(input, &non_det_states,
+                                                    &sample_budget)
+                          ->num_states()};
+        bp_twa bp(input, cut_det_, opt_, true, &sample_budget);
+        return {true, bp.res_aut()->num_states()};
+      }
+    catch (const budget_exceeded& e)
+      {
+        // Only the sample is too large; the other limits are the user's
+        if (e.resource() != budget_exceeded::states)
+          throw;
+      }
+
+    spot::scc_info si(input);
+    uint64_t acc_states = 0;
+    for (unsigned scc = 0; scc < si.scc_count(); ++scc)
+      if (si.is_accepting_scc(scc))
+        acc_states += si.states_of(scc).size();
+    uint64_t levels = std::max(1u, input->num_sets());
+    return {false, acc_states * levels
+                   * (1 + spot::count_nondet_states(input))};
+  }
+
+  // Keeps in `todo` only the predict_ jobs with the smallest predicted
+  // results, in their original order. The inputs prepared for them are
+  // kept in `inputs`.
+  void select_predicted(std::vector<jobs_type>& todo,
+                        std::vector<spot::twa_graph_ptr>& inputs)
+  {
+    std::vector<prediction> pred;
+    std::vector<unsigned> order;
+    for (unsigned i = 0; i < todo.size(); ++i)
+      {
+        budget_.check_time();
+        inputs[i] = prepare_input(todo[i]);
+        pred.push_back(predict_size(inputs[i]));
+        order.push_back(i);
+      }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](unsigned a, unsigned b)
+                     {
+                       if (pred[a].exact != pred[b].exact)
+                         return pred[a].exact;
+                       return pred[a].size < pred[b].size;
+                     });
+    order.resize(predict_);
+    std::sort(order.begin(), order.end());
+
+    std::vector<jobs_type> kept_jobs;
+    std::vector<spot::twa_graph_ptr> kept_inputs;
+    for (unsigned i: order)
+      {
+        kept_jobs.push_back(todo[i]);
+        kept_inputs.push_back(inputs[i]);
+      }
+    todo.swap(kept_jobs);
+    inputs.swap(kept_inputs);
+  }
+
+  // The input of `job`. The inputs and the intermediate automata they
+  // are built from are computed once, and shared by the jobs that need
+  // them.
+  spot::twa_graph_ptr prepare_input(jobs_type job)
+  {
+    auto& res = prepared_[job];
+    if (res)
+      return res;
+    switch (job)
+      {
+      case ViaTGBA:
+        res = preproc_ ? simplify(input_, spot::postprocessor::TGBA) : input_;
+        break;
+      case ViaTBA:
+        res = degeneralized(false);
+        if (preproc_)
+          res = simplify(res, spot::postprocessor::TGBA);
+        break;
+      case ViaSBA:
+        res = preproc_ ? simplify(input_, spot::postprocessor::BA)
+                       : degeneralized(true);
+        break;
       default:
         assert(!"should not be reached");
       }
+    return res;
+  }
+
+  // The input degeneralized into a TBA, or an SBA if `state_based`. A
+  // Büchi input is its own TBA, and its own SBA if it is state-based.
+  spot::twa_graph_ptr degeneralized(bool state_based)
+  {
+    auto& res = state_based ? sba_ : tba_;
+    if (!res)
+      {
+        if (input_->acc().is_buchi()
+            && (!state_based || input_->prop_state_acc()))
+          res = input_;
+        else
+          res = state_based ? spot::degeneralize(input_)
+                            : spot::degeneralize_tba(input_);
+      }
+    return res;
+  }
+
+  // `aut` simplified by the preprocessor into `type`
+  spot::twa_graph_ptr simplify(const spot::twa_graph_ptr& aut,
+                               spot::postprocessor::output_type type)
+  {
+    auto& res = simplified_[{aut.get(), type}];
+    if (!res)
+      {
+        preprocessor_.set_type(type);
+        res = preprocessor_.run(aut);
+      }
+    return res;
   }
 
   spot::twa_graph_ptr process_job(spot::twa_graph_ptr input)
@@ -159,12 +490,13 @@ private:
         if (!cut_det_)
           result = input;
         else
-          result = determinize_first_component(input, &non_det_states);
+          result = determinize_first_component(input, &non_det_states,
+                                               &budget_);
       }
     else
       {
         // Run the breakpoint algorithm
-        bp_twa resbp(input, cut_det_, opt_);
+        bp_twa resbp(input, cut_det_, opt_, true, &budget_);
         result = resbp.res_aut();
         result->purge_dead_states();
       }
@@ -219,20 +551,74 @@ private:
   bool postproc_;
   bool preproc_;
   bool cut_det_;
+  bool parallel_ = false; // run the jobs in child processes
+  int cutoff_ = 0;        // abandon jobs that are cutoff_ times too large
+  int predict_ = 0;       // number of jobs kept by select_predicted()
+  bool reproducible_ = true; // see reproducible()
 
   // Prefered output types
   output_type output_;
 
+  // Limits shared by all jobs (the time limit starts with the object)
+  resource_budget budget_;
+
   // Spot's postprocesssor
   spot::postprocessor postprocessor_;
   spot::postprocessor preprocessor_;
+
+  // Memoized inputs of the jobs and intermediate automata
+  std::map<jobs_type, spot::twa_graph_ptr> prepared_;
+  spot::twa_graph_ptr tba_;
+  spot::twa_graph_ptr sba_;
+  std::map<std::pair<const spot::twa_graph*, int>,
+           spot::twa_graph_ptr> simplified_;
 };
 
+namespace
+{
+  std::unique_ptr<result_cache> the_cache;
+}
+
+void set_result_cache(const std::string& dir, unsigned max_mib)
+{
+  the_cache.reset(dir.empty() ? nullptr
+                  : new result_cache(dir, size_t(max_mib) << 20));
+}
+
+result_cache* get_result_cache()
+{
+  return the_cache.get();
+}
+
 aut_ptr semi_determinize(aut_ptr aut,
                          bool cut_det,
                          jobs_type jobs,
                          const_om_ptr opt)
 {
+  if (jobs == 0)
+    jobs = AllJobs;
+  std::string key;
+  if (the_cache)
+    {
+      std::ostringstream context;
+      // The parallelism and the budget do not change the result, and
+      // results that depend on the budget are not stored. (scc-decompose
+      // changes the numbering of the states, so it stays in the key.)
+      spot::option_map key_opt;
+      if (opt)
+        key_opt = *opt;
+      for (const char* name: {"threads", "parallel-jobs",
+                              "max-states", "max-memory", "time-limit"})
+        key_opt.set(name, 0);
+      context << "semi_determinize cut_det=" << cut_det << " jobs=" << jobs
+              << " options=" << key_opt;
+      key = result_cache::key(aut, context.str());
+      if (auto res = the_cache->lookup(key, aut->get_dict()))
+        return res;
+    }
   seminator sem(aut, cut_det, opt);
-  return sem.run(jobs);
+  auto res = sem.run(jobs);
+  if (the_cache && res && sem.reproducible())
+    the_cache->store(key, res);
+  return res;
 }
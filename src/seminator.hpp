@@ -18,8 +18,12 @@
 #pragma once
 
 #include <set>
+#include <string>
 #include <spot/twaalgos/postproc.hh>
 #include <spot/misc/optionmap.hh>
+#include <spot/twaalgos/word.hh>
+
+#include <budget.hpp>
 
 enum jobs_type_values { ViaTGBA = 1,
                         ViaTBA = 2,
@@ -34,12 +38,71 @@ enum output_type : int {TGBA = 0, TBA = 1, BA = 2};
 * Produce a cut-deterministic automaton if cut_det is true.
 *
 * Fine-tuning options may be passed via opt and jobs.
+*
+* The options max-states, max-memory, and time-limit of opt limit the
+* resources of each job (see resource_budget). Jobs that exceed them are
+* abandoned, and budget_exceeded is thrown if all jobs were abandoned.
 */
 spot::twa_graph_ptr semi_determinize(spot::twa_graph_ptr aut,
                                      bool cut_det = false,
                                      jobs_type jobs = AllJobs,
                                      const spot::option_map* opt = nullptr);
 
+/**
+* Build the semi-deterministic automaton for aut on the fly.
+*
+* The result is a spot::twa whose states are constructed only when they
+* are visited by the algorithm using it (for instance a product or an
+* emptiness check). Produce a cut-deterministic automaton if cut_det is
+* true. The same options as for semi_determinize() control the breakpoint
+* construction (except jump-to-bottommost), but aut is not pre- or
+* post-processed and must be a TGBA.
+*
+* Like semi_determinize(), an automaton with "t" acceptance is first
+* minimized as a DFA, and an input that is already deterministic or
+* cut-deterministic (or semi-deterministic if cut_det is false) is
+* returned as it is. The result is then a spot::twa_graph.
+*/
+spot::twa_ptr semi_determinize_lazy(spot::const_twa_graph_ptr aut,
+                                    bool cut_det = false,
+                                    const spot::option_map* opt = nullptr);
+
+/**
+* Check the language inclusion L(a) ⊆ L(b) of two TGBA on the fly.
+*
+* The product of a with the NCSB complement of the semi-deterministic
+* automaton for b is explored lazily (the states of both the
+* semi-deterministic automaton and of its complement are built only when
+* the emptiness check of the product reaches them), and the exploration
+* stops at the first accepting cycle.
+*
+* Returns nullptr if the language of a is included in that of b, and a
+* word of L(a) that is not in L(b) otherwise. The automata must share the
+* same bdd_dict. The options of opt control the semi-determinization as
+* for semi_determinize_lazy(). As there, b is minimized as a DFA if it
+* has "t" acceptance, and a semi-deterministic b is complemented as it
+* is.
+*/
+spot::twa_word_ptr inclusion_counterexample(spot::const_twa_graph_ptr a,
+                                            spot::const_twa_graph_ptr b,
+                                            const spot::option_map* opt
+                                            = nullptr);
+
+class result_cache;
+
+/**
+* Keep the results of semi_determinize() (and of the complementation in
+* the command-line tool) in a persistent cache stored in the directory
+* dir, bounded to max_mib mebibytes (0 for no bound). See result_cache.
+* An empty dir disables the cache (the default).
+*
+* Throws std::runtime_error if dir cannot be used as a cache.
+*/
+void set_result_cache(const std::string& dir, unsigned max_mib = 0);
+
+// The cache set by set_result_cache(), or nullptr
+result_cache* get_result_cache();
+
 namespace from_spot {
   /// \brief Complement a semideterministic TωA
   ///
@@ -49,8 +112,12 @@ namespace from_spot {
   /// S. Schewe, J. Strejček, and MH. Tsai (TACAS'16).
   /// Implements optimization suggested by YF. Chen, M. Heizmann,
   /// O. Lengál, Y. Li, MH. Tsai, A. Turrini, and L. Zhang (PLDI'18)
+  ///
+  /// The successors of the macrostates are computed on \a threads
+  /// threads (0 = one per core); the result does not depend on it.
   spot::twa_graph_ptr
-  complement_semidet(const spot::const_twa_graph_ptr &aut, bool show_names = false);
+  complement_semidet(const spot::const_twa_graph_ptr &aut, bool show_names = false,
+                     unsigned threads = 1);
 }
 
 typedef std::set<unsigned> state_set;
@@ -0,0 +1,121 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <simulation.hpp>
+
+direct_simulation::direct_simulation(const powerset_builder& psb,
+                                     const spot::scc_info* si)
+  : ns_(psb.num_states()),
+    nw_(psb.state_words()),
+    rows_(ns_ * nw_, 0)
+{
+  auto inside = [si](state_t s, state_t d)
+    {
+      return !si || si->scc_of(s) == si->scc_of(d);
+    };
+
+  // Start from the full relation (inside SCCs)
+  for (state_t y = 0; y < ns_; ++y)
+    for (state_t z = 0; z < ns_; ++z)
+      if (inside(y, z))
+        bits::set(row(y), z);
+
+  // Whether each edge of y is matched by an edge of z leading to a state
+  // simulating its destination. The edges are sorted by condition.
+  auto matches = [&](state_t y, state_t z)
+    {
+      auto f = psb.succ_begin(z);
+      auto fend = psb.succ_end(z);
+      for (auto e = psb.succ_begin(y); e != psb.succ_end(y); ++e)
+      {
+        if (!inside(y, e->dst))
+          continue;
+        while (f != fend && f->cond < e->cond)
+          ++f;
+        bool found = false;
+        for (auto g = f; g != fend && g->cond == e->cond; ++g)
+          if (inside(z, g->dst) && e->acc.subset(g->acc)
+              && bits::test(row(e->dst), g->dst))
+          {
+            found = true;
+            break;
+          }
+        if (!found)
+          return false;
+      }
+      return true;
+    };
+
+  // Refine until the greatest fixpoint is reached
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (state_t y = 0; y < ns_; ++y)
+      for (state_t z = bits::find_next(row(y), nw_, 0); z < ns_;
+           z = bits::find_next(row(y), nw_, z + 1))
+        if (z != y && !matches(y, z))
+        {
+          bits::clear(row(y), z);
+          changed = true;
+        }
+  }
+}
+
+void
+direct_simulation::prune(bits::word* p, bits::word* q,
+                         std::vector<bits::word>& drop) const
+{
+  // Whether y is dominated by another state of p
+  auto dominated = [&](state_t y)
+    {
+      const bits::word* sim = row(y);
+      bool qy = bits::test(q, y);
+      for (size_t i = 0; i < nw_; ++i)
+        for (bits::word w = sim[i] & p[i]; w; w &= w - 1)
+        {
+          state_t z = i * 64 + __builtin_ctzll(w);
+          if (z == y)
+            continue;
+          bool qz = bits::test(q, z);
+          if (qy && !qz)
+            continue;
+          if (!simulates(y, z) || (qz && !qy) || z < y)
+            return true;
+        }
+      return false;
+    };
+
+  // Decide for all states before removing any of them
+  drop.assign(nw_, 0);
+  bool any = false;
+  for (state_t y = bits::find_next(p, nw_, 0); y < ns_;
+       y = bits::find_next(p, nw_, y + 1))
+    if (dominated(y))
+    {
+      bits::set(drop.data(), y);
+      any = true;
+    }
+  if (!any)
+    return;
+  for (size_t i = 0; i < nw_; ++i)
+  {
+    p[i] &= ~drop[i];
+    q[i] &= p[i];
+  }
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <types.hpp>
+#include <bitops.hpp>
+#include <powerset.hpp>
+
+// Direct simulation preorder on the states of the automaton of a
+// powerset_builder.
+//
+// `z` simulates `y` if for every edge y -a,M-> y' there is an edge
+// z -a,M'-> z' with M ⊆ M' such that z' simulates y'. It is computed as a
+// greatest fixpoint over the successor index of the builder (so over its
+// letter classes), and takes ns² bits for ns states.
+//
+// With an scc_info, only the edges inside SCCs are considered, and only
+// states of the same SCC are related: this is the preorder that holds for
+// sets of states restricted to their SCC (the scc-aware optimization).
+//
+// The preorder is used to prune the successors of breakpoint states (see
+// prune()). For a successor (P', Q'), a state y is removed from P' (and Q')
+// if some z ≠ y in P' simulates y, z is in Q' if y is, and y does not
+// simulate z, unless z is in Q' and y is not, or z < y. This relation is a
+// strict partial order, so each removed state is simulated by a remaining
+// state with at least the same membership in Q'. The pruned breakpoint
+// construction follows a part of the runs of the original one (so it is
+// still sound), and between any two breakpoints of the original one it
+// reaches a breakpoint as well: it accepts the same words.
+class direct_simulation
+{
+public:
+  direct_simulation(const powerset_builder& psb,
+                    const spot::scc_info* si = nullptr);
+
+  // Whether `z` simulates `y`
+  bool simulates(state_t z, state_t y) const
+  {
+    return bits::test(row(y), z);
+  }
+
+  // Removes from `p` the states dominated by other states of `p` (see
+  // above), and intersects `q` with the result. Both are bitsets over the
+  // states of the builder; `drop` is scratch space.
+  void prune(bits::word* p, bits::word* q,
+             std::vector<bits::word>& drop) const;
+
+  // Approximate number of bytes used by the preorder
+  size_t memory_usage() const
+  {
+    return sizeof(*this) + rows_.capacity() * sizeof(bits::word);
+  }
+
+private:
+  // The states that simulate `y`
+  const bits::word* row(state_t y) const
+  {
+    return rows_.data() + y * nw_;
+  }
+
+  bits::word* row(state_t y)
+  {
+    return rows_.data() + y * nw_;
+  }
+
+  unsigned ns_;
+  size_t nw_;
+  std::vector<bits::word> rows_;
+};
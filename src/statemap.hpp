@@ -0,0 +1,160 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+// Hash of a 64-bit value (final avalanche step of MurmurHash3)
+inline size_t mix_hash(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Hashes for the keys of the constructions. Sets are interned (see
+// stateset.hpp), so hashing a key only mixes a few integers.
+struct state_key_hash
+{
+  size_t operator()(unsigned id) const
+  {
+    return mix_hash(id);
+  }
+
+  // (level, P, Q) of a breakpoint state
+  size_t operator()(const std::tuple<unsigned, unsigned, unsigned>& t) const
+  {
+    uint64_t pq = (uint64_t(std::get<1>(t)) << 32) | std::get<2>(t);
+    return mix_hash(pq ^ mix_hash(std::get<0>(t)));
+  }
+};
+
+// Map from keys of a construction to the states of the result.
+//
+// Open-addressing hash table with linear probing. The entries are stored
+// contiguously in insertion order together with their hash, so that
+// probing compares hashes before keys and growing the table never
+// rehashes keys. The load factor is kept under 1/2.
+template <class Key, class Hash = state_key_hash>
+class state_map_hash
+{
+public:
+  // Returned by get() for absent keys
+  static constexpr unsigned none = -1U;
+
+  explicit state_map_hash(size_t expected = 0)
+  {
+    reserve(expected);
+  }
+
+  // Prepares the table for `n` keys, so that it does not grow before
+  // holding more than `n` keys.
+  void reserve(size_t n)
+  {
+    entries_.reserve(n);
+    size_t nb = 16;
+    while (nb < 2 * n)
+      nb *= 2;
+    if (nb > buckets_.size())
+      rebuild(nb);
+  }
+
+  // The value of `key`, or `none` if absent.
+  unsigned get(const Key& key) const
+  {
+    size_t h = Hash()(key);
+    unsigned e = buckets_[probe(key, h)];
+    return e == none ? none : entries_[e].value;
+  }
+
+  size_t count(const Key& key) const
+  {
+    return get(key) != none;
+  }
+
+  // Maps `key` (which must be absent) to `value`.
+  void insert(const Key& key, unsigned value)
+  {
+    size_t h = Hash()(key);
+    size_t pos = probe(key, h);
+    assert(buckets_[pos] == none);
+    buckets_[pos] = entries_.size();
+    entries_.push_back({key, h, value});
+    if (2 * entries_.size() > buckets_.size())
+      rebuild(2 * buckets_.size());
+  }
+
+  size_t size() const
+  {
+    return entries_.size();
+  }
+
+  // Approximate number of bytes used by the table
+  size_t memory_usage() const
+  {
+    return entries_.capacity() * sizeof(entry)
+      + buckets_.capacity() * sizeof(unsigned);
+  }
+
+private:
+  struct entry
+  {
+    Key key;
+    size_t hash;
+    unsigned value;
+  };
+
+  // Position of `key` in buckets_, or of the free bucket where it belongs
+  size_t probe(const Key& key, size_t h) const
+  {
+    size_t mask = buckets_.size() - 1;
+    size_t pos = h & mask;
+    for (;;)
+      {
+        unsigned e = buckets_[pos];
+        if (e == none
+            || (entries_[e].hash == h && entries_[e].key == key))
+          return pos;
+        pos = (pos + 1) & mask;
+      }
+  }
+
+  void rebuild(size_t nb)
+  {
+    buckets_.assign(nb, none);
+    size_t mask = nb - 1;
+    for (unsigned e = 0; e < entries_.size(); ++e)
+      {
+        size_t pos = entries_[e].hash & mask;
+        while (buckets_[pos] != none)
+          pos = (pos + 1) & mask;
+        buckets_[pos] = e;
+      }
+  }
+
+  std::vector<entry> entries_;
+  std::vector<unsigned> buckets_;
+};
@@ -0,0 +1,132 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stateset.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+state_set_table::state_set_table()
+  : buckets_(16, -1U)
+{
+  // The empty set is always present with identifier 0.
+  offsets_.push_back(0);
+  set_id e = intern(nullptr, nullptr);
+  assert(e == empty_id);
+  (void) e;
+}
+
+size_t
+state_set_table::hash_range(const unsigned* begin, const unsigned* end)
+{
+  // FNV-1a over the elements followed by a final avalanche step
+  uint64_t h = 14695981039346656037ULL;
+  for (auto i = begin; i != end; ++i)
+    {
+      h ^= *i;
+      h *= 1099511628211ULL;
+    }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void
+state_set_table::grow()
+{
+  std::vector<set_id> nb(buckets_.size() * 2, -1U);
+  size_t mask = nb.size() - 1;
+  for (set_id id = 0; id < hashes_.size(); ++id)
+    {
+      size_t pos = hashes_[id] & mask;
+      while (nb[pos] != -1U)
+        pos = (pos + 1) & mask;
+      nb[pos] = id;
+    }
+  buckets_.swap(nb);
+}
+
+set_id
+state_set_table::intern(const unsigned* begin, const unsigned* end)
+{
+  assert(std::is_sorted(begin, end));
+  size_t h = hash_range(begin, end);
+  size_t len = end - begin;
+  size_t mask = buckets_.size() - 1;
+  size_t pos = h & mask;
+  for (;;)
+    {
+      set_id id = buckets_[pos];
+      if (id == -1U)
+        break;
+      if (hashes_[id] == h && size(id) == len
+          && std::equal(begin, end, this->begin(id)))
+        return id;
+      pos = (pos + 1) & mask;
+    }
+
+  // A new set
+  set_id id = hashes_.size();
+  if (id == -1U)
+    throw std::runtime_error("too many distinct sets of states");
+  buckets_[pos] = id;
+  hashes_.push_back(h);
+  elems_.insert(elems_.end(), begin, end);
+  offsets_.push_back(elems_.size());
+
+  // Keep the load factor under 1/2
+  if (2 * hashes_.size() > buckets_.size())
+    grow();
+  return id;
+}
+
+set_id
+state_set_table::intern(const state_set& ss)
+{
+  buf_.assign(ss.begin(), ss.end());
+  return intern(buf_.data(), buf_.data() + buf_.size());
+}
+
+set_id
+state_set_table::intern(const spot::bitvect& bv)
+{
+  buf_.clear();
+  unsigned ns = bv.size();
+  for (unsigned pos = 0; pos < ns; ++pos)
+    if (bv.get(pos))
+      buf_.push_back(pos);
+  return intern(buf_.data(), buf_.data() + buf_.size());
+}
+
+set_id
+state_set_table::intern_bits(const uint64_t* words, size_t nw)
+{
+  buf_.clear();
+  for (size_t i = 0; i < nw; ++i)
+    for (uint64_t w = words[i]; w; w &= w - 1)
+      buf_.push_back(i * 64 + __builtin_ctzll(w));
+  return intern(buf_.data(), buf_.data() + buf_.size());
+}
+
+bool
+state_set_table::contains(set_id id, unsigned s) const
+{
+  return std::binary_search(begin(id), end(id), s);
+}
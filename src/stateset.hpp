@@ -0,0 +1,115 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+
+#include <spot/misc/bitvect.hh>
+
+typedef std::set<unsigned> state_set;
+
+// Identifier of a set of states stored in a state_set_table.
+typedef unsigned set_id;
+
+// Hash-consing table for sets of states.
+//
+// Each distinct set is stored exactly once as a sorted run of state numbers
+// in one contiguous array and is referred to by its 32-bit identifier. Two
+// sets are equal iff their identifiers are equal, so the constructions can
+// use identifiers as cheap keys and compare sets in constant time.
+//
+// The identifier 0 (`empty_id`) always denotes the empty set.
+//
+// The elements of a set are accessed through `begin(id)` and `end(id)`. The
+// returned pointers are invalidated by the next call to `intern()`.
+class state_set_table {
+public:
+  static constexpr set_id empty_id = 0;
+
+  state_set_table();
+
+  // Returns the identifier of the set given by the sorted range
+  // [begin, end) of distinct states. Stores the set if it is new.
+  set_id intern(const unsigned* begin, const unsigned* end);
+  set_id intern(const state_set& ss);
+  set_id intern(const std::vector<unsigned>& sorted)
+  {
+    return intern(sorted.data(), sorted.data() + sorted.size());
+  }
+  // Interns the set of positions set to 1 in `bv`
+  set_id intern(const spot::bitvect& bv);
+  // Interns the set of positions set to 1 in the bitset of `nw` words
+  // starting at `words` (see bitops.hpp)
+  set_id intern_bits(const uint64_t* words, size_t nw);
+
+  const unsigned* begin(set_id id) const
+  {
+    return elems_.data() + offsets_[id];
+  }
+
+  const unsigned* end(set_id id) const
+  {
+    return elems_.data() + offsets_[id + 1];
+  }
+
+  unsigned size(set_id id) const
+  {
+    return offsets_[id + 1] - offsets_[id];
+  }
+
+  bool contains(set_id id, unsigned s) const;
+
+  state_set to_set(set_id id) const
+  {
+    return state_set(begin(id), end(id));
+  }
+
+  // Number of distinct sets stored so far (including the empty set)
+  unsigned count() const
+  {
+    return hashes_.size();
+  }
+
+  // Approximate number of bytes used by the table
+  size_t memory_usage() const
+  {
+    return elems_.capacity() * sizeof(unsigned)
+      + offsets_.capacity() * sizeof(size_t)
+      + hashes_.capacity() * sizeof(size_t)
+      + buckets_.capacity() * sizeof(set_id);
+  }
+
+private:
+  static size_t hash_range(const unsigned* begin, const unsigned* end);
+  void grow();
+
+  // Elements of all sets; the set `id` is stored in
+  // elems_[offsets_[id]] ... elems_[offsets_[id+1]-1]
+  std::vector<unsigned> elems_;
+  std::vector<size_t> offsets_;
+  // Hash of each set, kept to avoid rehashing when the table grows
+  std::vector<size_t> hashes_;
+  // Open-addressing index of the sets (-1U marks a free bucket)
+  std::vector<set_id> buckets_;
+  // Scratch buffer used to intern sets given in other representations
+  std::vector<unsigned> buf_;
+};
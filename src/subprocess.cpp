@@ -0,0 +1,257 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <subprocess.hpp>
+
+#include <cerrno>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <spot/parseaut/public.hh>
+#include <spot/twaalgos/hoa.hh>
+
+namespace
+{
+  [[noreturn]] void throw_errno(const char* what)
+  {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+
+  // Writes all of `data` to `fd`; gives up on errors
+  void write_all(int fd, const std::string& data)
+  {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left)
+      {
+        ssize_t n = write(fd, p, left);
+        if (n < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            return;
+          }
+        p += n;
+        left -= n;
+      }
+  }
+}
+
+child_process::child_process(const std::function<std::string()>& work)
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+    throw_errno("pipe");
+  pid_ = fork();
+  if (pid_ < 0)
+    {
+      int err = errno;
+      close(fds[0]);
+      close(fds[1]);
+      errno = err;
+      throw_errno("fork");
+    }
+  if (pid_ == 0)
+    {
+      close(fds[0]);
+      int status = 0;
+      std::string res;
+      try
+        {
+          res = work();
+        }
+      catch (const std::exception& e)
+        {
+          res = e.what();
+          status = 1;
+        }
+      catch (...)
+        {
+          res = "unknown error in child process";
+          status = 1;
+        }
+      write_all(fds[1], res);
+      close(fds[1]);
+      _exit(status);
+    }
+  close(fds[1]);
+  fd_ = fds[0];
+}
+
+child_process::~child_process()
+{
+  if (pid_ > 0)
+    kill();
+}
+
+void
+child_process::read_some()
+{
+  if (fd_ < 0)
+    return;
+  char buf[65536];
+  for (;;)
+    {
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n > 0)
+        {
+          output_.append(buf, n);
+          // Do not block if nothing more is available yet
+          struct pollfd p = { fd_, POLLIN, 0 };
+          if (poll(&p, 1, 0) <= 0)
+            return;
+          continue;
+        }
+      if (n < 0 && errno == EINTR)
+        continue;
+      // End of file (or error): the child is done with the pipe
+      close(fd_);
+      fd_ = -1;
+      return;
+    }
+}
+
+std::string
+child_process::finish()
+{
+  while (running())
+    {
+      struct pollfd p = { fd_, POLLIN, 0 };
+      if (poll(&p, 1, -1) < 0 && errno != EINTR)
+        throw_errno("poll");
+      read_some();
+    }
+  int status = 0;
+  while (waitpid(pid_, &status, 0) < 0)
+    if (errno != EINTR)
+      throw_errno("waitpid");
+  pid_ = -1;
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    return std::move(output_);
+  if (WIFEXITED(status) && !output_.empty())
+    throw std::runtime_error(output_);
+  throw std::runtime_error("child process failed");
+}
+
+void
+child_process::kill()
+{
+  if (fd_ >= 0)
+    {
+      close(fd_);
+      fd_ = -1;
+    }
+  if (pid_ > 0)
+    {
+      ::kill(pid_, SIGKILL);
+      while (waitpid(pid_, nullptr, 0) < 0 && errno == EINTR)
+        continue;
+      pid_ = -1;
+    }
+}
+
+std::string
+automaton_to_string(const spot::const_twa_graph_ptr& aut)
+{
+  std::ostringstream out;
+  spot::print_hoa(out, aut);
+  return out.str();
+}
+
+spot::twa_graph_ptr
+automaton_from_string(const std::string& hoa,
+                      const spot::bdd_dict_ptr& dict)
+{
+  spot::automaton_stream_parser parser(hoa.c_str(), "child process");
+  auto parsed = parser.parse(dict);
+  std::ostringstream errors;
+  if (parsed->format_errors(errors) || !parsed->aut)
+    throw std::runtime_error("cannot read the automaton of a child process\n"
+                             + errors.str());
+  return parsed->aut;
+}
+
+shared_minimum::shared_minimum()
+{
+  void* mem = mmap(nullptr, sizeof(std::atomic<unsigned>),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  mapped_ = mem != MAP_FAILED;
+  if (mapped_)
+    value_ = new (mem) std::atomic<unsigned>(-1U);
+  else
+    value_ = new std::atomic<unsigned>(-1U);
+}
+
+shared_minimum::~shared_minimum()
+{
+  if (mapped_)
+    munmap(value_, sizeof(std::atomic<unsigned>));
+  else
+    delete value_;
+}
+
+void
+shared_minimum::update(unsigned v)
+{
+  unsigned cur = value_->load();
+  while (v < cur && !value_->compare_exchange_weak(cur, v))
+    continue;
+}
+
+bool
+read_any(const std::vector<child_process*>& children,
+         const std::function<void(size_t)>& progress)
+{
+  std::vector<struct pollfd> fds;
+  std::vector<size_t> index;
+  for (size_t i = 0; i < children.size(); ++i)
+    if (children[i]->running())
+      {
+        fds.push_back({ children[i]->fd(), POLLIN, 0 });
+        index.push_back(i);
+      }
+  if (fds.empty())
+    return false;
+  while (poll(fds.data(), fds.size(), -1) < 0)
+    if (errno != EINTR)
+      throw_errno("poll");
+  for (size_t j = 0; j < fds.size(); ++j)
+    if (fds[j].revents)
+      {
+        children[index[j]]->read_some();
+        if (progress)
+          progress(index[j]);
+      }
+  return true;
+}
+
+void
+read_all(const std::vector<child_process*>& children,
+         const std::function<void(size_t)>& progress)
+{
+  while (read_any(children, progress))
+    continue;
+}
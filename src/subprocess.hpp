@@ -0,0 +1,126 @@
+// Copyright (c) 2017-2020  The Seminator Authors
+//
+// This file is a part of Seminator, a tool for semi-determinization
+// of omega automata.
+//
+// Seminator is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// Seminator is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <spot/twa/twagraph.hh>
+
+// A computation run in a child process created by fork().
+//
+// Spot and BuDDy are not thread-safe, so independent constructions on the
+// same bdd_dict can only run concurrently in separate processes. The child
+// runs `work` on a copy of the memory of the parent and sends the returned
+// string back through a pipe (usually an automaton in the HOA format). If
+// `work` throws, the child sends the message of the exception instead and
+// finish() rethrows it as a std::runtime_error.
+//
+// The child leaves with _exit(), so it never flushes the stdio buffers
+// it shares with the parent nor runs destructors of static objects.
+class child_process
+{
+public:
+  explicit child_process(const std::function<std::string()>& work);
+  // Kills the child if it is still running
+  ~child_process();
+
+  child_process(const child_process&) = delete;
+  child_process& operator=(const child_process&) = delete;
+
+  // Whether the child has not closed its pipe yet
+  bool running() const
+  {
+    return fd_ >= 0;
+  }
+
+  // The read end of the pipe (-1 once closed)
+  int fd() const
+  {
+    return fd_;
+  }
+
+  // Reads the data available on the pipe without blocking for more;
+  // closes the pipe at its end.
+  void read_some();
+
+  // Waits for the end of the child and returns what it sent. Throws
+  // std::runtime_error if the child failed.
+  std::string finish();
+
+  // Kills the child; finish() must not be called afterwards.
+  void kill();
+
+private:
+  pid_t pid_ = -1;
+  int fd_ = -1;
+  std::string output_;
+};
+
+// An unsigned value that only decreases, shared by a process with the
+// children it creates afterwards. It lives in an anonymous shared mapping,
+// so that the updates of the children are seen by the parent and by the
+// other children. (If the mapping cannot be created, the value is private
+// to each process, which is still correct for a sequential use.)
+class shared_minimum
+{
+public:
+  shared_minimum();
+  ~shared_minimum();
+
+  shared_minimum(const shared_minimum&) = delete;
+  shared_minimum& operator=(const shared_minimum&) = delete;
+
+  // -1U until the first update
+  unsigned get() const
+  {
+    return value_->load();
+  }
+
+  // Lowers the value to `v` if it is smaller
+  void update(unsigned v);
+
+private:
+  std::atomic<unsigned>* value_;
+  bool mapped_;
+};
+
+// Automata are exchanged with child processes (and stored by the
+// result_cache) in the HOA format. The
+// automaton read back uses `dict`, which should be the dictionary of the
+// parent, so that its atomic propositions are the same BDD variables.
+std::string automaton_to_string(const spot::const_twa_graph_ptr& aut);
+spot::twa_graph_ptr automaton_from_string(const std::string& hoa,
+                                          const spot::bdd_dict_ptr& dict);
+
+// Waits until data arrive on the pipe of one of the `children` that are
+// running, and reads the data available on all of them. Returns false if
+// none of them is running.
+bool read_any(const std::vector<child_process*>& children,
+              const std::function<void(size_t)>& progress = nullptr);
+
+// Reads the pipes of all `children` as their data arrive, until all of
+// them are closed. `progress` (if set) is called after each read with the
+// index of the child; it may kill children.
+void read_all(const std::vector<child_process*>& children,
+              const std::function<void(size_t)>& progress = nullptr);
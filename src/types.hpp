@@ -36,10 +36,13 @@
 #include <spot/twaalgos/sccinfo.hh>
 
 #include <seminator.hpp>
+#include <stateset.hpp>
+#include <statemap.hpp>
 
 // Simple and PowerSet in 1st component,
-// BreakPoint and PowerSet in 2nd component
-enum class State_type {SIMPLE1,PS1,BP2,PS2};
+// BreakPoint and PowerSet in 2nd component,
+// and states of SCCs reused as they are in 2nd component
+enum class State_type {SIMPLE1,PS1,BP2,PS2,REUSED2};
 
 
 typedef unsigned state_t;
@@ -52,25 +55,24 @@ typedef typename state_set::iterator ss_it;
 typedef typename state_vect::iterator sv_it;
 
 // TODO: change to class/struct
-typedef std::tuple<unsigned, state_set, state_set> breakpoint_state;
+// P and Q are identifiers of sets interned in a state_set_table
+typedef std::tuple<unsigned, set_id, set_id> breakpoint_state;
 // In text, P corresponds to R and Q to B.
 struct Bp{enum size_t {LEVEL = 0, P = 1, Q = 2};};
 
 
 
 
-typedef std::vector<state_set> succ_vect;
+typedef std::vector<set_id> succ_vect;
 
-typedef std::map<breakpoint_state, state_t> breakpoint_map;
-typedef std::map<state_set, state_t> power_map;
+typedef state_map_hash<breakpoint_state> breakpoint_map;
+typedef state_map_hash<set_id> power_map;
 typedef std::map<state_t, state_t> state_map;
 
 typedef spot::const_twa_graph_ptr const_aut_ptr;
 typedef spot::twa_graph_ptr aut_ptr;
 typedef std::vector<std::string>* state_names;
 
-typedef std::unique_ptr<succ_vect> succ_vect_ptr;
-
 typedef const spot::option_map* const_om_ptr;
 
 static const state_set empty_set;
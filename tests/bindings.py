@@ -7,3 +7,32 @@ res = sem.semi_determinize(aut)
 assert aut.num_states() == 4
 assert res.num_states() == 5
 assert aut.equivalent_to(res)
+
+# The on-the-fly construction explores only what the product needs
+lazy = sem.semi_determinize_lazy(aut)
+assert not lazy.intersects(spot.translate('!G(a | (b U (Gc | Gd)))'))
+assert lazy.intersects(spot.translate('GFa & GFb'))
+lazy_res = spot.make_twa_graph(lazy, spot.twa_prop_set.all())
+assert aut.equivalent_to(lazy_res)
+lazy_cd = sem.semi_determinize_lazy(aut, cut_det=True)
+assert aut.equivalent_to(spot.make_twa_graph(lazy_cd, spot.twa_prop_set.all()))
+
+# Deterministic and "t" automata are semi-deterministic already
+det = spot.translate('GFa', 'deterministic')
+for cut_det in (False, True):
+    lazy_det = sem.semi_determinize_lazy(det, cut_det=cut_det)
+    assert det.equivalent_to(spot.make_twa_graph(lazy_det,
+                                                 spot.twa_prop_set.all()))
+safe = spot.automaton("""HOA: v1 States: 2 Start: 0 AP: 1 "a"
+Acceptance: 0 t --BODY-- State: 0 [0] 0 [0] 1 State: 1 [!0] 1 --END--""")
+lazy_safe = sem.semi_determinize_lazy(safe)
+assert safe.equivalent_to(spot.make_twa_graph(lazy_safe,
+                                              spot.twa_prop_set.all()))
+
+# Inclusion check with a counterexample
+a = spot.translate('GFa | GFb')
+b = spot.translate('GFa')
+assert sem.inclusion_counterexample(b, a) is None
+word = sem.inclusion_counterexample(a, b)
+assert a.intersects(word.as_automaton())
+assert not b.intersects(word.as_automaton())